@@ -0,0 +1,348 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "mem.h"
+#include "xp.h"
+#include "xpw.h"
+#include "ap.h"
+#include "mp.h"
+#include "except.h"
+#define TIME(us, stmt) do { long r_, n_ = 1; double t0_; \
+	for (;;) { \
+		t0_ = now(); \
+		for (r_ = 0; r_ < n_; r_++) { stmt; } \
+		if ((us = now() - t0_) > 0.05) break; \
+		n_ *= 2; \
+	} \
+	us = us*1e6/n_; } while (0)
+long allocs, live;
+const Except_T Mem_Failed = { "Allocation failed" };
+void *Mem_alloc(long nbytes, const char *file, int line) {
+	void *ptr = malloc(nbytes);
+	if (ptr == NULL)
+		Except_raise(&Mem_Failed, file, line);
+	allocs++;
+	live++;
+	return ptr;
+}
+void *Mem_calloc(long count, long nbytes, const char *file, int line) {
+	void *ptr = calloc(count, nbytes);
+	if (ptr == NULL)
+		Except_raise(&Mem_Failed, file, line);
+	allocs++;
+	live++;
+	return ptr;
+}
+void Mem_free(void *ptr, const char *file, int line) {
+	if (ptr)
+		live--;
+	free(ptr);
+}
+void *Mem_resize(void *ptr, long nbytes, const char *file, int line) {
+	ptr = realloc(ptr, nbytes);
+	if (ptr == NULL)
+		Except_raise(&Mem_Failed, file, line);
+	allocs++;
+	return ptr;
+}
+static double now(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+static void randbytes(unsigned char *x, int n) {
+	int i;
+	for (i = 0; i < n; i++)
+		x[i] = rand();
+	x[n-1] |= 0x80;
+}
+static AP_T randap(int bits) {
+	AP_T x;
+	int i, n = bits/4;
+	char *str = ALLOC(n + 1);
+	for (i = 0; i < n; i++)
+		str[i] = "0123456789abcdef"[rand()%16];
+	str[0] = "89abcdef"[rand()%8];
+	str[n] = '\0';
+	x = AP_fromstr(str, 16, NULL);
+	FREE(str);
+	return x;
+}
+static void mul(int maxbits) {
+	int bits;
+	printf("%6s %10s %10s %10s %10s %10s %10s %10s\n", "bits",
+		"XP_mul", "XPW_mul", "XP_div", "XPW_div",
+		"AP_mul", "AP_div", "MP_mul");
+	for (bits = 64; bits <= maxbits; bits *= 4) {
+		int n = bits/8, w = bits/XPW_BITS;
+		unsigned char *x = ALLOC(2*n), *y = ALLOC(n), *z = ALLOC(2*n),
+			*r = ALLOC(n), *tmp = ALLOC(3*n + 2);
+		XPW_limb *xw = ALLOC(2*w*sizeof *xw), *yw = ALLOC(w*sizeof *yw),
+			*zw = ALLOC(2*w*sizeof *zw), *rw = ALLOC(w*sizeof *rw),
+			*tw = ALLOC((3*w + 2)*sizeof *tw);
+		AP_T ax = randap(2*bits), ay = randap(bits), az = randap(bits);
+		MP_T mx, my, mz;
+		double t;
+		randbytes(x, n);
+		randbytes(y, n);
+		XPW_frombytes(w, xw, n, x);
+		XPW_frombytes(w, yw, n, y);
+		printf("%6d", bits);
+		TIME(t, memset(z, 0, 2*n); XP_mul(z, n, x, n, y));
+		printf(" %10.2f", t);
+		TIME(t, memset(zw, 0, 2*w*sizeof *zw); XPW_mul(zw, w, xw, w, yw));
+		printf(" %10.2f", t);
+		memcpy(x, z, 2*n);
+		memcpy(xw, zw, 2*w*sizeof *xw);
+		TIME(t, XP_div(2*n, z, x, n, y, r, tmp));
+		printf(" %10.2f", t);
+		TIME(t, XPW_div(2*w, zw, xw, w, yw, rw, tw));
+		printf(" %10.2f", t);
+		TIME(t, AP_T q = AP_mul(ay, az); AP_free(&q));
+		printf(" %10.2f", t);
+		TIME(t, AP_T q = AP_div(ax, ay); AP_free(&q));
+		printf(" %10.2f", t);
+		MP_set(bits);
+		mx = MP_new(0);
+		my = MP_new(0);
+		mz = ALLOC(2*n);
+		memcpy(mx, x, n);
+		memcpy(my, y, n);
+		TIME(t, MP_mul2u(mz, mx, my));
+		printf(" %10.2f\n", t);
+		FREE(mx);
+		FREE(my);
+		FREE(mz);
+		AP_free(&ax);
+		AP_free(&ay);
+		AP_free(&az);
+		FREE(x);
+		FREE(y);
+		FREE(z);
+		FREE(r);
+		FREE(tmp);
+		FREE(xw);
+		FREE(yw);
+		FREE(zw);
+		FREE(rw);
+		FREE(tw);
+	}
+}
+static void karatsuba(int maxbits) {
+	int n;
+	printf("%6s %6s %10s %10s %10s %10s\n", "limbs", "bits",
+		"basecase", "XPW_mul", "XPW_square", "XP_mul");
+	for (n = 8; n*XPW_BITS <= maxbits; n += n < 32 ? 8 : n < 128 ? 16 : n) {
+		int i, nb = n*XPW_BITS/8;
+		XPW_limb *x = ALLOC(n*sizeof *x), *y = ALLOC(n*sizeof *y),
+			*z = ALLOC((2*n + 8)*sizeof *z);
+		unsigned char *xb = ALLOC(nb), *yb = ALLOC(nb), *zb = ALLOC(2*nb);
+		double t;
+		randbytes(xb, nb);
+		randbytes(yb, nb);
+		XPW_frombytes(n, x, nb, xb);
+		XPW_frombytes(n, y, nb, yb);
+		printf("%6d %6d", n, n*XPW_BITS);
+		TIME(t, memset(z, 0, (2*n + 8)*sizeof *z);
+			for (i = 0; i < n; i += 8)
+				XPW_mul(z + i, n, x, 8, y + i));
+		printf(" %10.2f", t);
+		TIME(t, memset(z, 0, 2*n*sizeof *z); XPW_mul(z, n, x, n, y));
+		printf(" %10.2f", t);
+		TIME(t, memset(z, 0, 2*n*sizeof *z); XPW_square(z, n, x));
+		printf(" %10.2f", t);
+		if (n <= 256) {
+			TIME(t, memset(zb, 0, 2*nb); XP_mul(zb, nb, xb, nb, yb));
+			printf(" %10.2f\n", t);
+		} else
+			printf(" %10s\n", "-");
+		FREE(x);
+		FREE(y);
+		FREE(z);
+		FREE(xb);
+		FREE(yb);
+		FREE(zb);
+	}
+}
+static void conv(int maxdigits) {
+	int digits;
+	printf("%8s %12s %12s %12s %12s\n", "digits",
+		"fromstr(10)", "tostr(10)", "fromstr(16)", "tostr(16)");
+	for (digits = 1000; digits <= maxdigits; digits *= 10) {
+		int i, base;
+		char *str = ALLOC(digits + 1), *out = ALLOC(digits + 2);
+		printf("%8d", digits);
+		for (base = 10; base <= 16; base += 6) {
+			AP_T x = NULL;
+			long blocks = live;
+			double t;
+			for (i = 0; i < digits; i++)
+				str[i] = "0123456789ABCDEF"[rand()%base];
+			str[0] = '1';
+			str[digits] = '\0';
+			TIME(t, if (x) AP_free(&x); x = AP_fromstr(str, base, NULL));
+			printf(" %12.1f", t);
+			TIME(t, AP_tostr(out, digits + 2, base, x));
+			printf(" %12.1f", t);
+			if (strcmp(out, str) != 0)
+				printf(" (mismatch)");
+			AP_free(&x);
+			if (live != blocks)
+				printf(" (leaked %ld blocks)", live - blocks);
+		}
+		printf("\n");
+		FREE(str);
+		FREE(out);
+	}
+}
+static void power(int maxbits) {
+	int bits;
+	printf("%6s %12s %12s\n", "bits", "odd p ms", "even p ms");
+	for (bits = 1024; bits <= maxbits; bits *= 2) {
+		AP_T p = randap(bits), x = randap(bits - 8), e = randap(bits), q;
+		double t;
+		if (AP_modi(p, 2) == 0) {
+			q = AP_addi(p, 1);
+			AP_free(&p);
+			p = q;
+		}
+		printf("%6d", bits);
+		TIME(t, q = AP_pow(x, e, p); AP_free(&q));
+		printf(" %12.2f", t/1000);
+		q = AP_addi(p, 1);
+		AP_free(&p);
+		p = q;
+		TIME(t, q = AP_pow(x, e, p); AP_free(&q));
+		printf(" %12.2f\n", t/1000);
+		AP_free(&p);
+		AP_free(&x);
+		AP_free(&e);
+	}
+}
+static AP_T factorial(int n, int into) {
+	AP_T f = AP_new(1);
+	int i;
+	for (i = 2; i <= n; i++)
+		if (into)
+			AP_muli_into(f, f, i);
+		else {
+			AP_T g = AP_muli(f, i);
+			AP_free(&f);
+			f = g;
+		}
+	return f;
+}
+static void fact(int n) {
+	int into;
+	printf("%d!:\n%22s %8s %8s\n", n, "", "allocs", "ms");
+	for (into = 0; into <= 1; into++) {
+		AP_T f;
+		long count = allocs;
+		double t;
+		f = factorial(n, into);
+		count = allocs - count;
+		AP_free(&f);
+		TIME(t, f = factorial(n, into); AP_free(&f));
+		printf("%22s %8ld %8.2f\n",
+			into ? "AP_muli_into" : "AP_muli, AP_free", count, t/1000);
+	}
+}
+static AP_T euclid(AP_T x, AP_T y) {
+	AP_T u = AP_addi(x, 0), v = AP_addi(y, 0);
+	while (AP_cmpi(v, 0) != 0) {
+		AP_T r = AP_mod(u, v);
+		AP_free(&u);
+		u = v;
+		v = r;
+	}
+	AP_free(&v);
+	return u;
+}
+static void gcd(int maxbits) {
+	int bits;
+	printf("%6s %10s %10s %10s %10s\n", "bits",
+		"AP_gcd", "euclid", "AP_invmod", "AP_isqrt");
+	for (bits = 256; bits <= maxbits; bits *= 4) {
+		AP_T x = randap(bits), y = randap(bits), p = randap(bits), g, h;
+		double t;
+		int ok;
+		if (AP_modi(p, 2) == 0) {
+			g = AP_addi(p, 1);
+			AP_free(&p);
+			p = g;
+		}
+		g = AP_gcd(x, y);
+		h = euclid(x, y);
+		ok = AP_cmp(g, h) == 0;
+		AP_free(&g);
+		AP_free(&h);
+		printf("%6d", bits);
+		TIME(t, g = AP_gcd(x, y); AP_free(&g));
+		printf(" %10.2f", t);
+		TIME(t, h = euclid(x, y); AP_free(&h));
+		printf(" %10.2f", t);
+		TIME(t, g = AP_invmod(x, p); if (g) AP_free(&g));
+		printf(" %10.2f", t);
+		TIME(t, g = AP_isqrt(x); AP_free(&g));
+		printf(" %10.2f%s\n", t, ok ? "" : " (mismatch)");
+		AP_free(&x);
+		AP_free(&y);
+		AP_free(&p);
+	}
+}
+static void divide(int maxbits) {
+	int bits;
+	printf("%6s %10s %10s %10s %10s\n", "bits",
+		"tostr(10)", "divi", "modi", "div 2^k");
+	for (bits = 256; bits <= maxbits; bits *= 4) {
+		AP_T x = randap(bits), one = AP_new(1), y = AP_lshift(one, bits/2), q;
+		int size = bits/3 + 2;
+		char *str = ALLOC(size);
+		double t;
+		printf("%6d", bits);
+		TIME(t, AP_tostr(str, size, 10, x));
+		printf(" %10.2f", t);
+		TIME(t, q = AP_divi(x, 1000000007); AP_free(&q));
+		printf(" %10.2f", t);
+		TIME(t, AP_modi(x, 1000000007));
+		printf(" %10.2f", t);
+		TIME(t, q = AP_div(x, y); AP_free(&q));
+		printf(" %10.2f\n", t);
+		FREE(str);
+		AP_free(&x);
+		AP_free(&y);
+		AP_free(&one);
+	}
+}
+static struct {
+	const char *name;
+	void (*run)(int max);
+	int max;
+} benches[] = {
+	{ "mul", mul, 65536 },
+	{ "karatsuba", karatsuba, 65536 },
+	{ "conv", conv, 1000000 },
+	{ "pow", power, 4096 },
+	{ "fact", fact, 10000 },
+	{ "gcd", gcd, 65536 },
+	{ "div", divide, 16384 },
+};
+int main(int argc, char *argv[]) {
+	int i, ran = 0;
+	srand(1);
+	for (i = 0; i < (int)(sizeof benches/sizeof benches[0]); i++)
+		if (argc < 2 || strcmp(argv[1], benches[i].name) == 0) {
+			printf("%s:\n", benches[i].name);
+			benches[i].run(argc >= 3 ? atoi(argv[2]) : benches[i].max);
+			ran++;
+		}
+	if (ran == 0) {
+		fprintf(stderr, "usage: %s [", argv[0]);
+		for (i = 0; i < (int)(sizeof benches/sizeof benches[0]); i++)
+			fprintf(stderr, "%s%s", i ? "|" : "", benches[i].name);
+		fprintf(stderr, "] [max]\n");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "assert.h"
+#include "mem.h"
+#include "atom.h"
+#include "thread.h"
+#include "sem.h"
+struct args {
+	int id;
+	const char **atoms;
+};
+long nkeys;
+char **keys;
+Sem_T go;
+static double now(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+static int intern(void *cl) {
+	struct args *p = cl;
+	long i, j = p->id/2*(nkeys/8)%nkeys;
+	Sem_wait(&go);
+	for (i = 0; i < nkeys; i++) {
+		p->atoms[j] = Atom_string(keys[j]);
+		if (p->id%2)
+			j = j == 0 ? nkeys - 1 : j - 1;
+		else
+			j = j == nkeys - 1 ? 0 : j + 1;
+	}
+	return EXIT_SUCCESS;
+}
+static double run(int n, const char **atoms[]) {
+	int i;
+	double t0;
+	for (i = 0; i < n; i++) {
+		struct args args;
+		args.id = i;
+		args.atoms = atoms[i];
+		Thread_new(intern, &args, sizeof args, NULL);
+	}
+	t0 = now();
+	for (i = 0; i < n; i++)
+		Sem_signal(&go);
+	Thread_join(NULL);
+	return now() - t0;
+}
+static void check(int n, const char **atoms[]) {
+	long i;
+	int k;
+	for (i = 0; i < nkeys; i++) {
+		assert(strcmp(atoms[0][i], keys[i]) == 0);
+		assert(Atom_length(atoms[0][i]) == (int)strlen(keys[i]));
+		for (k = 1; k < n; k++)
+			assert(atoms[k][i] == atoms[0][i]);
+	}
+}
+int main(int argc, char *argv[]) {
+	int n, i, max = argc >= 2 ? atoi(argv[1]) : 8;
+	long j, total = 0;
+	const char ***atoms;
+	Atom_Stats stats;
+	Thread_init(1, NULL);
+	nkeys = argc >= 3 ? atol(argv[2]) : 1000000;
+	keys = CALLOC(nkeys, sizeof *keys);
+	atoms = CALLOC(max, sizeof *atoms);
+	for (i = 0; i < max; i++)
+		atoms[i] = CALLOC(nkeys, sizeof **atoms);
+	Sem_init(&go, 0);
+	printf("%7s %10s %10s %10s %8s %8s %8s\n", "threads",
+		"cold Mop/s", "warm Mop/s", "buckets",
+		"maxchain", "avgchain", "probes");
+	for (n = 1; n <= max; n *= 2) {
+		double cold, warm;
+		for (j = 0; j < nkeys; j++) {
+			char buf[48];
+			sprintf(buf, "key%d.%lu", n, j*2654435761UL%1000000007UL);
+			FREE(keys[j]);
+			keys[j] = strcpy(ALLOC(strlen(buf) + 1), buf);
+		}
+		total += nkeys;
+		cold = run(n, atoms);
+		check(n, atoms);
+		warm = run(n, atoms);
+		check(n, atoms);
+		Atom_stats(&stats);
+		assert(stats.atoms == total);
+		printf("%7d %10.2f %10.2f %10ld %8ld %8.2f %8.2f\n", n,
+			n*nkeys/cold/1e6, n*nkeys/warm/1e6, stats.buckets,
+			stats.maxchain, stats.avgchain, stats.probes);
+	}
+	{
+		double t0 = now(), t1;
+		for (j = 0; j < nkeys; j++)
+			Atom_length(atoms[0][j]);
+		t1 = now();
+		for (j = 0; j < nkeys; j++)
+			Atom_hash(atoms[0][j]);
+		printf("Atom_length %.1f ns, Atom_hash %.1f ns (%ld atoms)\n",
+			(t1 - t0)*1e9/nkeys, (now() - t1)*1e9/nkeys, total);
+	}
+	Thread_exit(EXIT_SUCCESS);
+	return EXIT_SUCCESS;
+}
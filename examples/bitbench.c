@@ -0,0 +1,338 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include "except.h"
+#include "mem.h"
+#include "bit.h"
+#include "roar.h"
+#include "pool.h"
+#include "thread.h"
+#include "sem.h"
+#define TIME(us, stmt) do { long r_, n_ = 1; double t0_; \
+	for (;;) { \
+		t0_ = now(); \
+		for (r_ = 0; r_ < n_; r_++) { stmt; } \
+		if ((us = now() - t0_) > 0.05) break; \
+		n_ *= 2; \
+	} \
+	us = us*1e6/n_; } while (0)
+union header {
+	long size;
+	max_align_t align;
+};
+atomic_long inuse;
+const Except_T Mem_Failed = { "Allocation failed" };
+void *Mem_alloc(long nbytes, const char *file, int line) {
+	union header *h = malloc(sizeof *h + nbytes);
+	if (h == NULL)
+		Except_raise(&Mem_Failed, file, line);
+	h->size = nbytes;
+	inuse += nbytes;
+	return h + 1;
+}
+void *Mem_calloc(long count, long nbytes, const char *file, int line) {
+	union header *h = calloc(1, sizeof *h + count*nbytes);
+	if (h == NULL)
+		Except_raise(&Mem_Failed, file, line);
+	h->size = count*nbytes;
+	inuse += count*nbytes;
+	return h + 1;
+}
+void Mem_free(void *ptr, const char *file, int line) {
+	if (ptr) {
+		union header *h = (union header *)ptr - 1;
+		inuse -= h->size;
+		free(h);
+	}
+}
+void *Mem_resize(void *ptr, long nbytes, const char *file, int line) {
+	union header *h = (union header *)ptr - 1;
+	long size = h->size;
+	h = realloc(h, sizeof *h + nbytes);
+	if (h == NULL)
+		Except_raise(&Mem_Failed, file, line);
+	h->size = nbytes;
+	inuse += nbytes - size;
+	return h + 1;
+}
+struct args {
+	int id;
+	Bit_T set;
+	long marks;
+	atomic_long *tally;
+};
+Sem_T go;
+static unsigned long seed = 88172645463325252UL;
+static unsigned long xorshift(void) {
+	seed ^= seed<<13;
+	seed ^= seed>>7;
+	seed ^= seed<<17;
+	return seed;
+}
+static double now(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+static void ops(int max) {
+	long n;
+	printf("%11s %10s %10s %10s\n", "bits", "count", "range op", "union");
+	for (n = 1024; n <= max; n *= 32) {
+		Bit_T s = Bit_new(n), t = Bit_new(n), u;
+		double us;
+		int count;
+		Bit_set(s, n/4, n/2);
+		Bit_set(t, n/3, n - 1);
+		printf("%11ld", n);
+		TIME(us, count = Bit_count(s));
+		printf(" %10.3f", us);
+		TIME(us, Bit_not(s, 1, n - 2));
+		printf(" %10.3f", us);
+		TIME(us, u = Bit_union(s, t); Bit_free(&u));
+		printf(" %10.3f\n", us);
+		if (count != n/4 + 1)
+			printf("(count %d)\n", count);
+		Bit_free(&s);
+		Bit_free(&t);
+	}
+}
+static void visit(int n, int bit, void *cl) {
+	*(long *)cl += bit;
+}
+static void visitset(int n, void *cl) {
+	(*(long *)cl)++;
+}
+static void iter(int max) {
+	Bit_T set = Bit_new(max);
+	long i, count, k = 0;
+	int n, ones = max/1000;
+	double us;
+	for (i = 0; i < ones; i++)
+		while (Bit_put(set, rand()%max, 1) == 1)
+			;
+	printf("%d bits, %d set\n%20s %12s\n", max, ones, "", "us");
+	count = 0;
+	TIME(us, Bit_map(set, visit, &count));
+	printf("%20s %12.1f\n", "Bit_map", us);
+	count = 0;
+	TIME(us, Bit_mapset(set, visitset, &count));
+	printf("%20s %12.1f\n", "Bit_mapset", us);
+	count = 0;
+	TIME(us, for (n = Bit_next_set(set, 0); n >= 0;
+			n = Bit_next_set(set, n + 1))
+		count++);
+	printf("%20s %12.1f\n", "Bit_next_set loop", us);
+	TIME(us, k = (k + 7919)%max; Bit_rank(set, k));
+	printf("%20s %12.3f\n", "Bit_rank", us);
+	TIME(us, k = (k + 7919)%ones; Bit_select(set, k));
+	printf("%20s %12.3f\n", "Bit_select", us);
+	TIME(us, Bit_put(set, 0, Bit_get(set, 0)); Bit_index(set));
+	printf("%20s %12.1f\n", "Bit_index", us);
+	TIME(us, k = (k + 7919)%max; Bit_rank(set, k));
+	printf("%20s %12.3f\n", "indexed Bit_rank", us);
+	TIME(us, k = (k + 7919)%ones; Bit_select(set, k));
+	printf("%20s %12.3f\n", "indexed Bit_select", us);
+	for (i = 0, n = Bit_next_set(set, 0); n >= 0;
+			i++, n = Bit_next_set(set, n + 1))
+		if (Bit_rank(set, n) != i || Bit_select(set, i) != n) {
+			printf("rank/select mismatch at bit %d\n", n);
+			break;
+		}
+	Bit_free(&set);
+}
+static Bit_T fill(int n, double density) {
+	Bit_T set = Bit_new(n);
+	long i;
+	if (density < 0) {
+		for (i = xorshift()%200000; i < n; i += 1 + xorshift()%200000) {
+			long hi = i + xorshift()%2000;
+			Bit_set(set, i, hi < n ? hi : n - 1);
+			i = hi;
+		}
+	} else if (density < 0.01)
+		for (i = density*n; i > 0; i--)
+			Bit_put(set, xorshift()%n, 1);
+	else {
+		unsigned long cut = density*(double)~0UL;
+		for (i = 0; i < n; i++)
+			if (xorshift() < cut)
+				Bit_put(set, i, 1);
+	}
+	return set;
+}
+static void roar(int max) {
+	double densities[] = { 1e-6, 1e-4, 1e-2, 0.5, -1 };
+	int i;
+	printf("%d bits, MB per set, times in ms as Roar_T/Bit_T\n", max);
+	printf("%8s %9s %9s %14s %14s %14s\n", "density", "roar MB", "Bit_T MB",
+		"union", "inter", "count");
+	for (i = 0; i < (int)(sizeof densities/sizeof densities[0]); i++) {
+		long size = inuse, bytes;
+		Bit_T s = fill(max, densities[i]), t = fill(max, densities[i]), u;
+		Roar_T rs, rt, ru;
+		double us, ur;
+		bytes = inuse - size;
+		size = inuse;
+		rs = Roar_frombit(s);
+		rt = Roar_frombit(t);
+		Roar_optimize(rs);
+		Roar_optimize(rt);
+		if (densities[i] < 0)
+			printf("%8s", "runs");
+		else
+			printf("%8g", densities[i]);
+		printf(" %9.3f %9.3f", (inuse - size)/2e6, bytes/2e6);
+		TIME(ur, ru = Roar_union(rs, rt); Roar_free(&ru));
+		TIME(us, u = Bit_union(s, t); Bit_free(&u));
+		printf(" %6.3f/%-7.3f", ur/1000, us/1000);
+		TIME(ur, ru = Roar_inter(rs, rt); Roar_free(&ru));
+		TIME(us, u = Bit_inter(s, t); Bit_free(&u));
+		printf(" %6.3f/%-7.3f", ur/1000, us/1000);
+		TIME(ur, Roar_count(rs));
+		TIME(us, Bit_count(s));
+		printf(" %6.3f/%-7.3f", ur/1000, us/1000);
+		ru = Roar_union(rs, rt);
+		u = Bit_union(s, t);
+		if (Roar_count(ru) != Bit_count(u))
+			printf(" (union differs)");
+		printf("\n");
+		Roar_free(&ru);
+		Bit_free(&u);
+		Roar_free(&rs);
+		Roar_free(&rt);
+		Bit_free(&s);
+		Bit_free(&t);
+	}
+}
+static void file(int max) {
+	const char *path = "bitbench.bits";
+	Bit_T heap = Bit_new(max), mapped;
+	long i, puts = 20000000L*(max/1024)/(1 << 20), gets = 100000, found = 0;
+	double t0;
+	remove(path);
+	mapped = Bit_open(path, max);
+	printf("%d bits, %ld random puts, %ld random gets\n%20s %10s\n",
+		max, puts, gets, "", "ms");
+	seed = 1;
+	t0 = now();
+	for (i = 0; i < puts; i++)
+		Bit_put(heap, xorshift()%max, 1);
+	printf("%20s %10.2f\n", "heap Bit_put", (now() - t0)*1e3);
+	seed = 1;
+	t0 = now();
+	for (i = 0; i < puts; i++)
+		Bit_put(mapped, xorshift()%max, 1);
+	printf("%20s %10.2f\n", "mapped Bit_put", (now() - t0)*1e3);
+	t0 = now();
+	Bit_close(&mapped);
+	printf("%20s %10.2f\n", "Bit_close", (now() - t0)*1e3);
+	t0 = now();
+	mapped = Bit_open(path, -1);
+	printf("%20s %10.3f\n", "Bit_open", (now() - t0)*1e3);
+	t0 = now();
+	for (i = 0; i < gets; i++)
+		found += Bit_get(mapped, xorshift()%max);
+	printf("%20s %10.2f\n", "Bit_get", (now() - t0)*1e3);
+	t0 = now();
+	i = Bit_count(mapped);
+	printf("%20s %10.2f\n", "Bit_count", (now() - t0)*1e3);
+	if (i != Bit_count(heap) || !Bit_eq(heap, mapped))
+		printf("reopened set differs\n");
+	Bit_close(&mapped);
+	Bit_free(&heap);
+	remove(path);
+}
+static int marker(void *cl) {
+	struct args *p = cl;
+	unsigned long x = 88172645463325252UL + p->id;
+	long i, won = 0;
+	int n = Bit_length(p->set);
+	Sem_wait(&go);
+	for (i = 0; i < p->marks; i++) {
+		x ^= x<<13;
+		x ^= x>>7;
+		x ^= x<<17;
+		if (i%4 == 3)
+			won -= Bit_atomic_clear(p->set, x%n);
+		else
+			won += !Bit_test_and_set(p->set, x%n);
+	}
+	*p->tally += won;
+	return EXIT_SUCCESS;
+}
+static void mark(int max) {
+	int n, i, length = 1 << 24;
+	long marks = 4000000;
+	Thread_T *t = CALLOC(max, sizeof *t);
+	Sem_init(&go, 0);
+	printf("%d bits, %ld marks per thread\n", length, marks);
+	printf("%7s %10s %10s %12s\n", "threads", "Mmarks/s",
+		"count us", "pcount us");
+	for (n = 1; n <= max; n *= 2) {
+		Bit_T set = Bit_new(length);
+		Pool_T pool = Pool_new(n);
+		atomic_long tally = 0;
+		double t0, s, us;
+		int count, pcount;
+		for (i = 0; i < n; i++) {
+			struct args args;
+			args.id = i;
+			args.set = set;
+			args.marks = marks;
+			args.tally = &tally;
+			t[i] = Thread_new(marker, &args, sizeof args, NULL);
+		}
+		t0 = now();
+		for (i = 0; i < n; i++)
+			Sem_signal(&go);
+		for (i = 0; i < n; i++)
+			Thread_join(t[i]);
+		s = now() - t0;
+		printf("%7d %10.1f", n, n*marks/s/1e6);
+		TIME(us, count = Bit_count(set));
+		printf(" %10.1f", us);
+		TIME(us, pcount = Bit_parallel_count(set, pool));
+		printf(" %12.1f", us);
+		if (count != tally || pcount != tally)
+			printf(" (tally %ld, count %d, pcount %d)",
+				(long)tally, count, pcount);
+		printf("\n");
+		Pool_free(&pool);
+		Bit_free(&set);
+	}
+	FREE(t);
+}
+static struct {
+	const char *name;
+	void (*run)(int max);
+	int max;
+} benches[] = {
+	{ "ops", ops, 1 << 30 },
+	{ "iter", iter, 100000000 },
+	{ "roar", roar, 1 << 28 },
+	{ "file", file, 1 << 30 },
+	{ "mark", mark, 8 },
+};
+int main(int argc, char *argv[]) {
+	int i, ran = 0;
+	Thread_init(1, NULL);
+	srand(1);
+	for (i = 0; i < (int)(sizeof benches/sizeof benches[0]); i++)
+		if (argc < 2 || strcmp(argv[1], benches[i].name) == 0) {
+			printf("%s:\n", benches[i].name);
+			benches[i].run(argc >= 3 ? atoi(argv[2]) : benches[i].max);
+			ran++;
+		}
+	if (ran == 0) {
+		fprintf(stderr, "usage: %s [", argv[0]);
+		for (i = 0; i < (int)(sizeof benches/sizeof benches[0]); i++)
+			fprintf(stderr, "%s%s", i ? "|" : "", benches[i].name);
+		fprintf(stderr, "] [max]\n");
+		Thread_exit(EXIT_FAILURE);
+	}
+	Thread_exit(EXIT_SUCCESS);
+	return EXIT_SUCCESS;
+}
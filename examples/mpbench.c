@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "mem.h"
+#include "mp.h"
+#include "thread.h"
+#include "sem.h"
+#define TIME(ns, stmt) do { long r_, n_ = 1; double t0_; \
+	for (;;) { \
+		t0_ = now(); \
+		for (r_ = 0; r_ < n_; r_++) { stmt; } \
+		if ((ns = now() - t0_) > 0.05) break; \
+		n_ *= 2; \
+	} \
+	ns = ns*1e9/n_; } while (0)
+struct args {
+	int id, bits;
+};
+long iters;
+char **results;
+Sem_T go;
+static double now(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+static char *hash(int bits) {
+	int n = bits/8;
+	long i;
+	MP_T h = MP_new(0), k = MP_new(0), p = MP_new(0), w = ALLOC(2*n);
+	char *str;
+	MP_fromstr(p, "100000001b3", 16, NULL);
+	for (i = 0; i < iters; i++) {
+		MP_fromintu(k, i);
+		MP_xor(h, h, k);
+		MP_mul2u(w, h, p);
+		memcpy(h, w, n);
+	}
+	str = MP_tostr(NULL, 0, 16, h);
+	FREE(h);
+	FREE(k);
+	FREE(p);
+	FREE(w);
+	return str;
+}
+static int worker(void *cl) {
+	struct args *p = cl;
+	MP_Ctx ctx = NULL;
+	if (p->id%2) {
+		ctx = MP_newctx(p->bits);
+		MP_usectx(ctx);
+	} else
+		MP_set(p->bits);
+	Sem_wait(&go);
+	results[p->id] = hash(p->bits);
+	if (ctx)
+		MP_freectx(&ctx);
+	return EXIT_SUCCESS;
+}
+static int width(int i) {
+	return 64 + 32*(i%8);
+}
+static void threads(int max) {
+	int n, i;
+	char **ref = CALLOC(8, sizeof *ref);
+	Thread_T *t = CALLOC(max, sizeof *t);
+	results = CALLOC(max, sizeof *results);
+	Sem_init(&go, 0);
+	for (i = 0; i < 8 && i < max; i++) {
+		MP_set(width(i));
+		ref[i] = hash(width(i));
+	}
+	printf("%7s %10s\n", "threads", "Mop/s");
+	for (n = 1; n <= max; n *= 2) {
+		double t0, s;
+		for (i = 0; i < n; i++) {
+			struct args args;
+			args.id = i;
+			args.bits = width(i);
+			t[i] = Thread_new(worker, &args, sizeof args, NULL);
+		}
+		t0 = now();
+		for (i = 0; i < n; i++)
+			Sem_signal(&go);
+		for (i = 0; i < n; i++)
+			Thread_join(t[i]);
+		s = now() - t0;
+		printf("%7d %10.2f", n, n*iters/s/1e6);
+		for (i = 0; i < n; i++) {
+			if (strcmp(results[i], ref[i%8]) != 0)
+				printf(" (thread %d wrong)", i);
+			FREE(results[i]);
+		}
+		printf("\n");
+	}
+	for (i = 0; i < 8; i++)
+		FREE(ref[i]);
+	FREE(ref);
+	FREE(t);
+	FREE(results);
+}
+static void widths(int max) {
+	int i, sizes[] = { 64, 128, 256, 512, 1024 };
+	printf("%6s %10s %10s\n", "bits", "add+sub", "mulu");
+	for (i = 0; i < (int)(sizeof sizes/sizeof sizes[0]) && sizes[i] <= max; i++) {
+		int bits;
+		for (bits = sizes[i] - 1; bits <= sizes[i] + 1; bits++) {
+			MP_T x, y, z;
+			double t;
+			MP_set(bits);
+			x = MP_new(0);
+			y = MP_new(0);
+			z = MP_new(0);
+			MP_fromstr(x, "12345678", 16, NULL);
+			MP_fromstr(y, "fedcba9", 16, NULL);
+			printf("%6d", bits);
+			TIME(t, MP_addu(z, x, y); MP_subu(x, z, y));
+			printf(" %10.1f", t);
+			TIME(t, MP_mulu(z, x, y));
+			printf(" %10.1f%s\n", t, bits == sizes[i] && bits <= 512 ? "  *" : "");
+			FREE(x);
+			FREE(y);
+			FREE(z);
+		}
+	}
+	printf("* word-sized fast path\n");
+}
+static struct {
+	const char *name;
+	void (*run)(int max);
+	int max;
+} benches[] = {
+	{ "threads", threads, 8 },
+	{ "widths", widths, 1024 },
+};
+int main(int argc, char *argv[]) {
+	int i, ran = 0;
+	Thread_init(1, NULL);
+	iters = 1000000;
+	for (i = 0; i < (int)(sizeof benches/sizeof benches[0]); i++)
+		if (argc < 2 || strcmp(argv[1], benches[i].name) == 0) {
+			printf("%s:\n", benches[i].name);
+			benches[i].run(argc >= 3 ? atoi(argv[2]) : benches[i].max);
+			ran++;
+		}
+	if (ran == 0) {
+		fprintf(stderr, "usage: %s [", argv[0]);
+		for (i = 0; i < (int)(sizeof benches/sizeof benches[0]); i++)
+			fprintf(stderr, "%s%s", i ? "|" : "", benches[i].name);
+		fprintf(stderr, "] [max]\n");
+		Thread_exit(EXIT_FAILURE);
+	}
+	Thread_exit(EXIT_SUCCESS);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,96 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "assert.h"
+#include "set.h"
+#define N 1000
+char names[2][N][12];
+static double now(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+static int cmp(const void *x, const void *y) {
+	return strcmp(x, y);
+}
+static unsigned hash(const void *x) {
+	const char *str = x;
+	unsigned h = 0;
+	while (*str)
+		h = (h<<1) + *str++;
+	return h;
+}
+static int owner(const void *member) {
+	return ((const char *)member - &names[0][0][0])/sizeof names[0];
+}
+static void keeps(Set_T set, int s, int t, int nt, int inter) {
+	void **members = Set_toArray(set, NULL);
+	int i;
+	for (i = 0; members[i]; i++) {
+		int key = atoi(members[i]);
+		assert(owner(members[i]) == (inter || key < nt ? t : s));
+	}
+	free(members);
+}
+static void check(void) {
+	int k, i;
+	for (i = 0; i < N; i++) {
+		sprintf(names[0][i], "%d", i);
+		strcpy(names[1][i], names[0][i]);
+	}
+	for (k = 0; k < 2; k++) {
+		int n[2], j;
+		Set_T sets[2], u;
+		n[0] = k ? N/4 : N;
+		n[1] = k ? N : N/4;
+		for (j = 0; j < 2; j++) {
+			sets[j] = Set_new(0, cmp, hash);
+			for (i = 0; i < n[j]; i++)
+				Set_put(sets[j], names[j][i]);
+		}
+		for (j = 0; j < 2; j++) {
+			u = Set_union(sets[j], sets[!j]);
+			assert(Set_length(u) == N);
+			keeps(u, j, !j, n[!j], 0);
+			Set_free(&u);
+			u = Set_inter(sets[j], sets[!j]);
+			assert(Set_length(u) == N/4);
+			keeps(u, j, !j, n[!j], 1);
+			Set_free(&u);
+		}
+		Set_free(&sets[0]);
+		Set_free(&sets[1]);
+	}
+}
+static double op(Set_T set(Set_T, Set_T), Set_T s, Set_T t, long expect) {
+	double t0 = now(), t1;
+	Set_T u = set(s, t);
+	t1 = now();
+	if (Set_length(u) != expect)
+		printf("(length %d, expected %ld) ", Set_length(u), expect);
+	Set_free(&u);
+	return (t1 - t0)*1e3;
+}
+int main(int argc, char *argv[]) {
+	long n, i, max = argc >= 2 ? atol(argv[1]) : 10000000;
+	check();
+	printf("%9s %9s %9s %9s %9s %9s\n", "members",
+		"build ms", "union ms", "inter ms", "minus ms", "diff ms");
+	for (n = 1000; n <= max; n *= 10) {
+		Set_T s = Set_new(n, NULL, NULL), t = Set_new(n, NULL, NULL);
+		double t0 = now();
+		for (i = 0; i < n; i++) {
+			Set_put(s, (void *)((i + 1)*8));
+			Set_put(t, (void *)((i + 1 + n/2)*8));
+		}
+		printf("%9ld %9.1f", n, (now() - t0)*1e3);
+		printf(" %9.1f", op(Set_union, s, t, n + n/2));
+		printf(" %9.1f", op(Set_inter, s, t, n - n/2));
+		printf(" %9.1f", op(Set_minus, s, t, n/2));
+		printf(" %9.1f\n", op(Set_diff, s, t, 2*(n/2)));
+		Set_free(&s);
+		Set_free(&t);
+	}
+	return EXIT_SUCCESS;
+}
@@ -5,12 +5,14 @@ static char rcsid[] = "$Id$" "\n$Id$";
 #include "assert.h"
 #include "fmt.h"
 #include "thread.h"
+#include "pool.h"
 #include "mem.h"
 struct args {
 	int *a;
 	int lb, ub;
 };
 int cutoff = 10000;
+Pool_T pool;
 #include <stdarg.h>
 #define Fmt_print outs
 
@@ -46,17 +48,15 @@ int quick(void *cl) {
 		p->lb = lb;
 		p->ub = k - 1;
 		if (k - lb > cutoff) {
-			Thread_T t;
-			t = Thread_new(quick, p, sizeof *p, NULL);
-			Fmt_print("thread %p sorted %d..%d\n", t, lb, k - 1);
+			Pool_spawn(pool, quick, p, sizeof *p);
+			Fmt_print("task sorted %d..%d\n", lb, k - 1);
 		} else
 			quick(p);
 		p->lb = k + 1;
 		p->ub = ub;
 		if (ub - k > cutoff) {
-			Thread_T t;
-			t = Thread_new(quick, p, sizeof *p, NULL);
-			Fmt_print("thread %p sorted %d..%d\n", t, k + 1, ub);
+			Pool_spawn(pool, quick, p, sizeof *p);
+			Fmt_print("task sorted %d..%d\n", k + 1, ub);
 		} else
 			quick(p);
 	}
@@ -64,13 +64,20 @@ int quick(void *cl) {
 }
 void sort(int *x, int n, int argc, char *argv[]) {
 	struct args args;
+	struct timespec start, stop;
 	if (argc >= 3)
 		cutoff = atoi(argv[2]);
+	pool = Pool_new(argc >= 4 ? atoi(argv[3]) : 4);
 	args.a = x;
 	args.lb = 0;
 	args.ub = n - 1;
+	timespec_get(&start, TIME_UTC);
 	quick(&args);
-	Thread_join(NULL);
+	Pool_sync(pool);
+	timespec_get(&stop, TIME_UTC);
+	fprintf(stderr, "sorted %d in %.3fs\n", n, (stop.tv_sec - start.tv_sec)
+		+ (stop.tv_nsec - start.tv_nsec)/1e9);
+	Pool_free(&pool);
 }
 main(int argc, char *argv[]) {
 	int i, n = 100000, *x, preempt;
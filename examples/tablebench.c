@@ -0,0 +1,66 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "mem.h"
+#include "table.h"
+static double now(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+static void shuffle(long *a, long n) {
+	long i;
+	for (i = n - 1; i > 0; i--) {
+		long j = rand()%(i + 1), t = a[i];
+		a[i] = a[j];
+		a[j] = t;
+	}
+}
+static void bench(long n, int flat, int reserve, long *order, char *keys) {
+	Table_T table = flat ? Table_new_flat(0, NULL, NULL)
+		: Table_new(0, NULL, NULL);
+	double t0, t1, worst = 0;
+	long i, found = 0;
+	if (reserve)
+		Table_reserve(table, n);
+	t0 = now();
+	for (i = 0; i < n; i++) {
+		double s = now(), d;
+		Table_put(table, keys + order[i], keys + order[i]);
+		if ((d = now() - s) > worst)
+			worst = d;
+	}
+	t1 = now();
+	printf(" %8.1f %9.1f", (t1 - t0)*1e9/n, worst*1e6);
+	shuffle(order, n);
+	t0 = now();
+	for (i = 0; i < n; i++)
+		found += Table_get(table, keys + order[i]) != NULL;
+	t1 = now();
+	printf(" %8.1f", (t1 - t0)*1e9/n);
+	if (found != n)
+		printf(" (lost %ld)", n - found);
+	Table_free(&table);
+}
+int main(int argc, char *argv[]) {
+	long n, i, max = argc >= 2 ? atol(argv[1]) : 10000000;
+	int flat;
+	long *order = CALLOC(max, sizeof *order);
+	char *keys = ALLOC(max);
+	printf("%7s %9s %8s %9s %8s %8s %9s %8s\n", "engine", "keys",
+		"put ns", "worst us", "get ns",
+		"rput ns", "rworst us", "rget ns");
+	for (flat = 0; flat <= 1; flat++)
+		for (n = 1000; n <= max; n *= 10) {
+			for (i = 0; i < n; i++)
+				order[i] = i;
+			shuffle(order, n);
+			printf("%7s %9ld", flat ? "flat" : "chained", n);
+			bench(n, flat, 0, order, keys);
+			bench(n, flat, 1, order, keys);
+			printf("\n");
+		}
+	FREE(order);
+	FREE(keys);
+	return EXIT_SUCCESS;
+}
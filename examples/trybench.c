@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "except.h"
+#include "thread.h"
+#include "sem.h"
+long iters;
+Sem_T go;
+const Except_T Bench_Failed = { "bench" };
+static double now(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+static int tryloop(void *cl) {
+	long i;
+	volatile long n = 0;
+	Sem_wait(&go);
+	for (i = 0; i < iters; i++)
+		TRY
+			n++;
+		END_TRY;
+	return n != iters;
+}
+static int raiseloop(void *cl) {
+	long i;
+	volatile long n = 0;
+	Sem_wait(&go);
+	for (i = 0; i < iters; i++)
+		TRY
+			RAISE(Bench_Failed);
+		EXCEPT(Bench_Failed)
+			n++;
+		END_TRY;
+	return n != iters;
+}
+static int fasttryloop(void *cl) {
+	long i;
+	volatile long n = 0;
+	Sem_wait(&go);
+	for (i = 0; i < iters; i++)
+		FAST_TRY
+			n++;
+		END_TRY;
+	return n != iters;
+}
+static int fastraiseloop(void *cl) {
+	long i;
+	volatile long n = 0;
+	Sem_wait(&go);
+	for (i = 0; i < iters; i++)
+		FAST_TRY
+			RAISE(Bench_Failed);
+		EXCEPT(Bench_Failed)
+			n++;
+		END_TRY;
+	return n != iters;
+}
+static double run(int n, int apply(void *)) {
+	int i;
+	double t0, t;
+	Thread_T *threads = calloc(n, sizeof *threads);
+	for (i = 0; i < n; i++)
+		threads[i] = Thread_new(apply, NULL, 0, NULL);
+	t0 = now();
+	for (i = 0; i < n; i++)
+		Sem_signal(&go);
+	for (i = 0; i < n; i++)
+		if (Thread_join(threads[i]) != 0)
+			fprintf(stderr, "thread %d lost iterations\n", i);
+	t = (now() - t0)*1e9/(n*iters);
+	free(threads);
+	return t;
+}
+int main(int argc, char *argv[]) {
+	int n, max = argc >= 2 ? atoi(argv[1]) : 8;
+	Thread_init(1, NULL);
+	iters = argc >= 3 ? atol(argv[2]) : 10000000;
+	Sem_init(&go, 0);
+	printf("%7s %10s %10s %12s %13s\n", "threads", "TRY ns", "RAISE ns",
+		"FAST_TRY ns", "fast RAISE ns");
+	for (n = 1; n <= max; n *= 2) {
+		printf("%7d", n);
+		printf(" %10.2f", run(n, tryloop));
+		printf(" %10.2f", run(n, raiseloop));
+		printf(" %12.2f", run(n, fasttryloop));
+		printf(" %13.2f\n", run(n, fastraiseloop));
+	}
+	Thread_exit(EXIT_SUCCESS);
+	return EXIT_SUCCESS;
+}
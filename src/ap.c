@@ -4,8 +4,9 @@
 #include <string.h>
 #include "assert.h"
 #include "ap.h"
+#include "arena.h"
 #include "fmt.h"
-#include "xp.h"
+#include "xpw.h"
 #include "mem.h"
 
 #define T AP_T
@@ -14,9 +15,14 @@ struct T {
 	int sign;
 	int ndigits;
 	int size;
-	XP_T digits;
+	XPW_T digits;
+	Arena_T arena;
 };
 
+#define BITS XPW_BITS
+
+#define LIMBS(nbytes) (((nbytes) + (int)sizeof (XPW_limb) - 1)/(int)sizeof (XPW_limb))
+
 #define iszero(x) ((x)->ndigits==1 && (x)->digits[0]==0)
 
 #define maxdigits(x,y) ((x)->ndigits > (y)->ndigits ? \
@@ -28,29 +34,55 @@ static T normalize(T z, int n);
 
 static int cmp(T x, T y);
 
+static _Thread_local Arena_T current;
+
 static T mk(int size) {
-    T z = CALLOC(1, sizeof (*z) + size);
+    T z;
     assert(size > 0);
+    if (current)
+	z = Arena_calloc(current, 1, sizeof (*z) + size*sizeof (XPW_limb),
+	    __FILE__, __LINE__);
+    else
+	z = CALLOC(1, sizeof (*z) + size*sizeof (XPW_limb));
     z->sign = 1;
     z->size = size;
     z->ndigits = 1;
-    z->digits = (XP_T)(z + 1);
+    z->digits = (XPW_T)(z + 1);
+    z->arena = current;
     return z;
 }
 
+static void grow(T z, int size) {
+    XPW_T digits;
+    if (z->size >= size)
+	return;
+    if (size < 2*z->size)
+	size = 2*z->size;
+    if (z->arena)
+	digits = Arena_alloc(z->arena, size*sizeof (XPW_limb),
+	    __FILE__, __LINE__);
+    else
+	digits = ALLOC(size*sizeof (XPW_limb));
+    memcpy(digits, z->digits, z->ndigits*sizeof (XPW_limb));
+    if (z->digits != (XPW_T)(z + 1) && z->arena == NULL)
+	FREE(z->digits);
+    z->digits = digits;
+    z->size = size;
+}
+
 static T set(T z, long int n) {
     if (n == LONG_MIN)
-	XP_fromint(z->size, z->digits, LONG_MAX + 1UL);
+	XPW_fromint(z->size, z->digits, LONG_MAX + 1UL);
     else if (n < 0)
-	XP_fromint(z->size, z->digits, -n);
+	XPW_fromint(z->size, z->digits, -n);
     else
-	XP_fromint(z->size, z->digits, n);
+	XPW_fromint(z->size, z->digits, n);
     z->sign = n < 0 ? -1 : 1;
     return normalize(z, z->size);
 }
 
 static T normalize(T z, int n) {
-    z->ndigits = XP_length(n, z->digits);
+    z->ndigits = XPW_length(n, z->digits);
     return z;
 }
 
@@ -59,25 +91,78 @@ static T add(T z, T x, T y) {
     if (x->ndigits < n)
 	return add(z, y, x);
     else if (x->ndigits > n) {
-	int carry = XP_add(n, z->digits, x->digits,
+	int carry = XPW_add(n, z->digits, x->digits,
 		y->digits, 0);
-	z->digits[z->size-1] = XP_sum(x->ndigits - n,
+	z->digits[x->ndigits] = XPW_sum(x->ndigits - n,
 		&z->digits[n], &x->digits[n], carry);
     } else
-	z->digits[n] = XP_add(n, z->digits, x->digits,
+	z->digits[n] = XPW_add(n, z->digits, x->digits,
 		y->digits, 0);
-    return normalize(z, z->size);
+    return normalize(z, x->ndigits + 1);
 }
 
 static T sub(T z, T x, T y) {
     int borrow, n = y->ndigits;
-    borrow = XP_sub(n, z->digits, x->digits,
+    borrow = XPW_sub(n, z->digits, x->digits,
 	    y->digits, 0);
     if (x->ndigits > n)
-	borrow = XP_diff(x->ndigits - n, &z->digits[n],
+	borrow = XPW_diff(x->ndigits - n, &z->digits[n],
 		&x->digits[n], borrow);
     assert(borrow == 0);
-    return normalize(z, z->size);
+    return normalize(z, x->ndigits);
+}
+
+static T sum(T z, T x, T y, int sign) {
+    if (x->sign == sign*y->sign) {
+	grow(z, maxdigits(x,y) + 1);
+	add(z, x, y);
+	z->sign = iszero(z) ? 1 : x->sign;
+    } else if (cmp(x, y) > 0) {
+	grow(z, x->ndigits);
+	sub(z, x, y);
+	z->sign = iszero(z) ? 1 : x->sign;
+    } else {
+	grow(z, y->ndigits);
+	sub(z, y, x);
+	z->sign = iszero(z) ? 1 : -x->sign;
+    }
+    return z;
+}
+
+static T product(T z, T x, T y) {
+    int n = x->ndigits + y->ndigits;
+    XPW_T digits;
+    if (x->ndigits == 1 || y->ndigits == 1) {
+	T s = y->ndigits == 1 ? x : y;
+	XPW_limb d = (s == x ? y : x)->digits[0];
+	int sign = (x->sign^y->sign) == 0 ? 1 : -1;
+	grow(z, n);
+	z->digits[n-1] = XPW_product(n - 1, z->digits, s->digits, d);
+	normalize(z, n);
+	z->sign = iszero(z) ? 1 : sign;
+	return z;
+    }
+    if (z == x || z == y)
+	digits = ALLOC(n*sizeof (XPW_limb));
+    else {
+	grow(z, n);
+	digits = z->digits;
+    }
+    memset(digits, '\0', n*sizeof (XPW_limb));
+    if (x == y)
+	XPW_square(digits, x->ndigits, x->digits);
+    else
+	XPW_mul(digits, x->ndigits, x->digits, y->ndigits,
+		y->digits);
+    if (digits != z->digits) {
+	grow(z, n);
+	memcpy(z->digits, digits, n*sizeof (XPW_limb));
+	FREE(digits);
+    }
+    normalize(z, n);
+    z->sign = iszero(z)
+	|| ((x->sign^y->sign) == 0) ? 1 : -1;
+    return z;
 }
 
 static T mulmod(T x, T y, T p) {
@@ -91,76 +176,108 @@ static int cmp(T x, T y) {
     if (x->ndigits != y->ndigits)
 	return x->ndigits - y->ndigits;
     else
-	return XP_cmp(x->ndigits, x->digits, y->digits);
+	return XPW_cmp(x->ndigits, x->digits, y->digits);
+}
+
+static int pow2(T y) {
+    int i, k = (y->ndigits - 1)*BITS;
+    XPW_limb d = y->digits[y->ndigits-1];
+    if (d&(d - 1))
+	return -1;
+    for (i = 0; i < y->ndigits - 1; i++)
+	if (y->digits[i] != 0)
+	    return -1;
+    for ( ; d > 1; d >>= 1)
+	k++;
+    return k;
+}
+
+static void divide(T q, T x, T y, T r) {
+    int k = pow2(y);
+    if (k >= 0) {
+	XPW_rshift(q->size, q->digits, x->ndigits, x->digits, k, 0);
+	memcpy(r->digits, x->digits, (x->ndigits < r->size
+	    ? x->ndigits : r->size)*sizeof (XPW_limb));
+	r->digits[k/BITS] &= ((XPW_limb)1<<(k%BITS)) - 1;
+    } else if (y->ndigits == 1)
+	r->digits[0] = XPW_quotient(x->ndigits, q->digits,
+	    x->digits, y->digits[0]);
+    else {
+	XPW_T tmp = ALLOC((x->ndigits + y->ndigits + 2)*sizeof (XPW_limb));
+	XPW_div(x->ndigits, q->digits, x->digits,
+		y->ndigits, y->digits, r->digits, tmp);
+	FREE(tmp);
+    }
 }
 
 T AP_new(long int n) {
-    return set(mk(sizeof (long int)), n);
+    return set(mk(LIMBS(sizeof (long int))), n);
 }
 
 void AP_free(T *z) {
     assert(z && *z);
-    FREE(*z);
+    if ((*z)->arena)
+	*z = NULL;
+    else {
+	if ((*z)->digits != (XPW_T)(*z + 1))
+	    FREE((*z)->digits);
+	FREE(*z);
+    }
+}
+
+Arena_T AP_arena(Arena_T arena) {
+    Arena_T prev = current;
+    current = arena;
+    return prev;
 }
 
 T AP_neg(T x) {
     T z;
     assert(x);
     z = mk(x->ndigits);
-    memcpy(z->digits, x->digits, x->ndigits);
+    memcpy(z->digits, x->digits, x->ndigits*sizeof (XPW_limb));
     z->ndigits = x->ndigits;
     z->sign = iszero(z) ? 1 : -x->sign;
     return z;
 }
 
 T AP_mul(T x, T y) {
-    T z;
     assert(x);
     assert(y);
-    z = mk(x->ndigits + y->ndigits);
-    XP_mul(z->digits, x->ndigits, x->digits, y->ndigits,
-	    y->digits);
-    normalize(z, z->size);
-    z->sign = iszero(z)
-	|| ((x->sign^y->sign) == 0) ? 1 : -1;
-    return z;
+    return product(mk(x->ndigits + y->ndigits), x, y);
 }
 
 T AP_add(T x, T y) {
-    T z;
     assert(x);
     assert(y);
-    if (((x->sign^y->sign) == 0)) {
-	z = add(mk(maxdigits(x,y) + 1), x, y);
-	z->sign = iszero(z) ? 1 : x->sign;
-    } else
-	if (cmp(x, y) > 0) {
-	    z = sub(mk(x->ndigits), x, y);
-	    z->sign = iszero(z) ? 1 : x->sign;
-	}
-	else {
-	    z = sub(mk(y->ndigits), y, x);
-	    z->sign = iszero(z) ? 1 : -x->sign;
-	}
-    return z;
+    return sum(mk(maxdigits(x,y) + 1), x, y, 1);
 }
 
 T AP_sub(T x, T y) {
-    T z;
     assert(x);
     assert(y);
-    if (!((x->sign^y->sign) == 0)) {
-	z = add(mk(maxdigits(x,y) + 1), x, y);
-	z->sign = iszero(z) ? 1 : x->sign;
-    } else
-	if (cmp(x, y) > 0) {
-	    z = sub(mk(x->ndigits), x, y);
-	    z->sign = iszero(z) ? 1 : x->sign;
-	} else {
-	    z = sub(mk(y->ndigits), y, x);
-	    z->sign = iszero(z) ? 1 : -x->sign;
-	}
-    return z;
+    return sum(mk(maxdigits(x,y) + 1), x, y, -1);
+}
+
+T AP_add_into(T z, T x, T y) {
+    assert(z);
+    assert(x);
+    assert(y);
+    return sum(z, x, y, 1);
+}
+
+T AP_sub_into(T z, T x, T y) {
+    assert(z);
+    assert(x);
+    assert(y);
+    return sum(z, x, y, -1);
+}
+
+T AP_mul_into(T z, T x, T y) {
+    assert(z);
+    assert(x);
+    assert(y);
+    return product(z, x, y);
 }
 
 T AP_div(T x, T y) {
@@ -170,22 +287,17 @@ T AP_div(T x, T y) {
     assert(!iszero(y));
     q = mk(x->ndigits);
     r = mk(y->ndigits);
-    {
-	XP_T tmp = ALLOC(x->ndigits + y->ndigits + 2);
-	XP_div(x->ndigits, q->digits, x->digits,
-		y->ndigits, y->digits, r->digits, tmp);
-	FREE(tmp);
-    }
+    divide(q, x, y, r);
     normalize(q, q->size);
     normalize(r, r->size);
-    q->sign = iszero(q)
-	|| ((x->sign^y->sign) == 0) ? 1 : -1;
     if (!((x->sign^y->sign) == 0) && !iszero(r)) {
-	int carry = XP_sum(q->size, q->digits,
+	int carry = XPW_sum(q->size, q->digits,
 		q->digits, 1);
 	assert(carry == 0);
 	normalize(q, q->size);
     }
+    q->sign = iszero(q)
+	|| ((x->sign^y->sign) == 0) ? 1 : -1;
     AP_free(&r);
     return q;
 }
@@ -197,18 +309,13 @@ T AP_mod(T x, T y) {
     assert(!iszero(y));
     q = mk(x->ndigits);
     r = mk(y->ndigits);
-    {
-	XP_T tmp = ALLOC(x->ndigits + y->ndigits + 2);
-	XP_div(x->ndigits, q->digits, x->digits,
-		y->ndigits, y->digits, r->digits, tmp);
-	FREE(tmp);
-    }
+    divide(q, x, y, r);
     normalize(q, q->size);
     normalize(r, r->size);
     q->sign = iszero(q)
 	|| ((x->sign^y->sign) == 0) ? 1 : -1;
     if (!((x->sign^y->sign) == 0) && !iszero(r)) {
-	int borrow = XP_sub(r->size, r->digits,
+	int borrow = XPW_sub(r->size, r->digits,
 		y->digits, r->digits, 0);
 	assert(borrow == 0);
 	normalize(r, r->size);
@@ -217,6 +324,60 @@ T AP_mod(T x, T y) {
     return r;
 }
 
+#define bit(x,i) (((x)->digits[(i)/BITS]>>((i)%BITS))&1)
+
+static T montpow(T x, T y, T p) {
+    int i, l, v, w, started = 0, n = p->ndigits,
+	nbits = y->ndigits*BITS;
+    XPW_limb k = XPW_montinv(p->digits[0]);
+    XPW_T g, z, x2, one, t;
+    T r;
+    while (!bit(y, nbits - 1))
+	nbits--;
+    w = nbits > 671 ? 6 : nbits > 239 ? 5 : nbits > 79 ? 4
+	: nbits > 23 ? 3 : 1;
+    g = CALLOC(((1<<(w - 1)) + 4)*n + 2, sizeof (XPW_limb));
+    z = g + (1<<(w - 1))*n;
+    x2 = z + n;
+    one = x2 + n;
+    t = one + n;
+    {
+	T xr = AP_mod(x, p), s = AP_lshift(xr, n*BITS);
+	r = AP_mod(s, p);
+	memcpy(g, r->digits, r->ndigits*sizeof (XPW_limb));
+	AP_free(&xr);
+	AP_free(&s);
+	AP_free(&r);
+    }
+    XPW_montmul(n, x2, g, g, p->digits, k, t);
+    for (i = 1; i < 1<<(w - 1); i++)
+	XPW_montmul(n, g + i*n, g + (i - 1)*n, x2, p->digits, k, t);
+    for (i = nbits - 1; i >= 0; ) {
+	if (!bit(y, i)) {
+	    XPW_montmul(n, z, z, z, p->digits, k, t);
+	    i--;
+	    continue;
+	}
+	for (l = i - w + 1 < 0 ? 0 : i - w + 1; !bit(y, l); l++)
+	    ;
+	for (v = 0; i >= l; i--) {
+	    v = (v<<1) | bit(y, i);
+	    if (started)
+		XPW_montmul(n, z, z, z, p->digits, k, t);
+	}
+	if (started)
+	    XPW_montmul(n, z, z, g + (v>>1)*n, p->digits, k, t);
+	else
+	    memcpy(z, g + (v>>1)*n, n*sizeof (XPW_limb));
+	started = 1;
+    }
+    one[0] = 1;
+    r = mk(n);
+    XPW_montmul(n, r->digits, z, one, p->digits, k, t);
+    FREE(g);
+    return normalize(r, n);
+}
+
 T AP_pow(T x, T y, T p) {
     T z;
     assert(x);
@@ -229,7 +390,9 @@ T AP_pow(T x, T y, T p) {
 	return AP_new(1);
     if (isone(x))
 	return AP_new((((y)->digits[0]&1) == 0) ? 1 : x->sign);
-    if (p)
+    if (p && (p->digits[0]&1))
+	z = montpow(x, y, p);
+    else if (p)
 	if (isone(y))
 	    z = AP_mod(x, p);
 	else {
@@ -259,6 +422,164 @@ T AP_pow(T x, T y, T p) {
     return z;
 }
 
+#define WINDOW (BITS - 2)
+
+static int bitlen(int n, XPW_T x) {
+    int k = (n - 1)*BITS;
+    XPW_limb d;
+    for (d = x[n-1]; d; d >>= 1)
+	k++;
+    return k;
+}
+
+static long long window(int n, XPW_T x, int s) {
+    int i = s/BITS, b = s%BITS;
+    XPW_limb w = x[i]>>b;
+    if (b && i + 1 < n)
+	w |= x[i+1]<<(BITS - b);
+    return (long long)(w&(((XPW_limb)1<<WINDOW) - 1));
+}
+
+static void combine(int n, XPW_T z, long long a, XPW_T x,
+	long long b, XPW_T y, XPW_T t) {
+    XPW_product(n, z, x, a < 0 ? -a : a);
+    XPW_product(n, t, y, b < 0 ? -b : b);
+    if (a >= 0 && b >= 0)
+	XPW_add(n, z, z, t, 0);
+    else if (a >= 0)
+	XPW_sub(n, z, z, t, 0);
+    else
+	XPW_sub(n, z, t, z, 0);
+}
+
+static T euclid(T x, T y, int inverse) {
+    int n = maxdigits(x, y) + 1, steps = 0;
+    XPW_T w = CALLOC(10*n, sizeof (XPW_limb)), t,
+	u = w, v = u + n, r = v + n, q = r + n,
+	c0 = q + n, c1 = c0 + n, d0 = c1 + n, d1 = d0 + n,
+	tmp = d1 + n;
+    T z;
+    if (cmp(x, y) > 0) {
+	T s = x;
+	x = y;
+	y = s;
+    }
+    memcpy(u, y->digits, y->ndigits*sizeof (XPW_limb));
+    memcpy(v, x->digits, x->ndigits*sizeof (XPW_limb));
+    c1[0] = 1;
+    for (;;) {
+	int k = 0, nu = XPW_length(n, u), nv = XPW_length(n, v),
+	    l = bitlen(nu, u);
+	long long a = 1, b = 0, c = 0, d = 1;
+	if (nv == 1 && v[0] == 0)
+	    break;
+	if (l > WINDOW) {
+	    long long uh = window(nu, u, l - WINDOW),
+		vh = window(nu, v, l - WINDOW), qh, s;
+	    while (vh + c != 0 && vh + d != 0) {
+		qh = (uh + a)/(vh + c);
+		if (qh != (uh + b)/(vh + d))
+		    break;
+		s = a - qh*c; a = c; c = s;
+		s = b - qh*d; b = d; d = s;
+		s = uh - qh*vh; uh = vh; vh = s;
+		k++;
+	    }
+	}
+	if (b == 0) {
+	    XPW_div(nu, q, u, nv, v, r, tmp);
+	    memset(r + nv, '\0', (n - nv)*sizeof (XPW_limb));
+	    if (inverse) {
+		memset(d0, '\0', n*sizeof (XPW_limb));
+		XPW_mul(d0, XPW_length(nu, q), q, XPW_length(n, c1), c1);
+		XPW_add(n, d0, d0, c0, 0);
+		t = c0; c0 = c1; c1 = d0; d0 = t;
+	    }
+	    t = u; u = v; v = r; r = t;
+	    steps++;
+	} else {
+	    combine(n, r, a, u, b, v, tmp);
+	    combine(n, q, c, u, d, v, tmp);
+	    t = u; u = r; r = t;
+	    t = v; v = q; q = t;
+	    if (inverse) {
+		combine(n, d0, a < 0 ? -a : a, c0, b < 0 ? -b : b, c1, tmp);
+		combine(n, d1, c < 0 ? -c : c, c0, d < 0 ? -d : d, c1, tmp);
+		t = c0; c0 = d0; d0 = t;
+		t = c1; c1 = d1; d1 = t;
+	    }
+	    steps += k;
+	}
+    }
+    if (!inverse) {
+	z = mk(n);
+	memcpy(z->digits, u, n*sizeof (XPW_limb));
+	normalize(z, n);
+    } else if (XPW_length(n, u) != 1 || u[0] != 1)
+	z = NULL;
+    else {
+	z = mk(n);
+	if (steps&1)
+	    memcpy(z->digits, c0, n*sizeof (XPW_limb));
+	else {
+	    memset(u, '\0', n*sizeof (XPW_limb));
+	    memcpy(u, y->digits, y->ndigits*sizeof (XPW_limb));
+	    XPW_sub(n, z->digits, u, c0, 0);
+	}
+	normalize(z, n);
+    }
+    FREE(w);
+    return z;
+}
+
+T AP_gcd(T x, T y) {
+    assert(x);
+    assert(y);
+    return euclid(x, y, 0);
+}
+
+T AP_invmod(T x, T p) {
+    T r, z;
+    assert(x);
+    assert(p);
+    assert(p->sign == 1 && !iszero(p) && !isone(p));
+    r = AP_mod(x, p);
+    z = euclid(r, p, 1);
+    AP_free(&r);
+    return z;
+}
+
+T AP_isqrt(T x) {
+    int n, l;
+    XPW_T w, s, t, q, r, tmp, u;
+    T z;
+    assert(x);
+    assert(x->sign == 1);
+    if (iszero(x))
+	return AP_new(0);
+    n = x->ndigits;
+    l = (bitlen(n, x->digits) + 1)/2;
+    w = CALLOC(6*n + 4, sizeof (XPW_limb));
+    s = w;
+    t = s + n + 1;
+    q = t + n + 1;
+    r = q + n;
+    tmp = r + n;
+    s[l/BITS] = (XPW_limb)1<<(l%BITS);
+    for (;;) {
+	XPW_div(n, q, x->digits, XPW_length(n, s), s, r, tmp);
+	t[n] = XPW_add(n, t, s, q, 0);
+	XPW_rshift(n + 1, t, n + 1, t, 1, 0);
+	if (XPW_cmp(n + 1, t, s) >= 0)
+	    break;
+	u = s; s = t; t = u;
+    }
+    z = mk(n);
+    memcpy(z->digits, s, n*sizeof (XPW_limb));
+    FREE(w);
+    return normalize(z, n);
+}
+
 int AP_cmp(T x, T y) {
     assert(x);
     assert(y);
@@ -271,55 +592,110 @@ int AP_cmp(T x, T y) {
 }
 
 T AP_addi(T x, long int y) {
-    unsigned char d[sizeof (unsigned long)];
+    XPW_limb d[LIMBS(sizeof (unsigned long))];
     struct T t;
-    t.size = sizeof d;
+    t.size = LIMBS(sizeof (unsigned long));
     t.digits = d;
     return AP_add(x, set(&t, y));
 }
 
+T AP_addi_into(T z, T x, long int y) {
+    XPW_limb d[LIMBS(sizeof (unsigned long))];
+    struct T t;
+    assert(z);
+    assert(x);
+    t.size = LIMBS(sizeof (unsigned long));
+    t.digits = d;
+    return sum(z, x, set(&t, y), 1);
+}
+
 T AP_subi(T x, long int y) {
-    unsigned char d[sizeof (unsigned long)];
+    XPW_limb d[LIMBS(sizeof (unsigned long))];
     struct T t;
-    t.size = sizeof d;
+    t.size = LIMBS(sizeof (unsigned long));
     t.digits = d;
     return AP_sub(x, set(&t, y));
 }
 
+T AP_subi_into(T z, T x, long int y) {
+    XPW_limb d[LIMBS(sizeof (unsigned long))];
+    struct T t;
+    assert(z);
+    assert(x);
+    t.size = LIMBS(sizeof (unsigned long));
+    t.digits = d;
+    return sum(z, x, set(&t, y), -1);
+}
+
 T AP_muli(T x, long int y) {
-    unsigned char d[sizeof (unsigned long)];
+    XPW_limb d[LIMBS(sizeof (unsigned long))];
     struct T t;
-    t.size = sizeof d;
+    t.size = LIMBS(sizeof (unsigned long));
     t.digits = d;
     return AP_mul(x, set(&t, y));
 }
 
-T AP_divi(T x, long int y) {
-    unsigned char d[sizeof (unsigned long)];
+T AP_muli_into(T z, T x, long int y) {
+    XPW_limb d[LIMBS(sizeof (unsigned long))];
     struct T t;
-    t.size = sizeof d;
+    assert(z);
+    assert(x);
+    t.size = LIMBS(sizeof (unsigned long));
     t.digits = d;
-    return AP_div(x, set(&t, y));
+    return product(z, x, set(&t, y));
+}
+
+T AP_divi(T x, long int y) {
+    unsigned long u = y < 0 ? -(unsigned long)y : y;
+    assert(x);
+    assert(y != 0);
+    if ((XPW_limb)u == u) {
+	T q = mk(x->ndigits);
+	int neg = (x->sign < 0) != (y < 0);
+	if (XPW_quotient(x->ndigits, q->digits, x->digits, u) != 0 && neg)
+	    XPW_sum(q->size, q->digits, q->digits, 1);
+	normalize(q, q->size);
+	q->sign = iszero(q) || !neg ? 1 : -1;
+	return q;
+    } else {
+	XPW_limb d[LIMBS(sizeof (unsigned long))];
+	struct T t;
+	t.size = LIMBS(sizeof (unsigned long));
+	t.digits = d;
+	return AP_div(x, set(&t, y));
+    }
 }
 
 int AP_cmpi(T x, long int y) {
-    unsigned char d[sizeof (unsigned long)];
+    XPW_limb d[LIMBS(sizeof (unsigned long))];
     struct T t;
-    t.size = sizeof d;
+    t.size = LIMBS(sizeof (unsigned long));
     t.digits = d;
     return AP_cmp(x, set(&t, y));
 }
 
 long int AP_modi(T x, long int y) {
     long int rem;
-    T r;
-    unsigned char d[sizeof (unsigned long)];
-    struct T t;
-    t.size = sizeof d;
-    t.digits = d;
-    r = AP_mod(x, set(&t, y));
-    rem = XP_toint(r->ndigits, r->digits);
-    AP_free(&r);
+    unsigned long u = y < 0 ? -(unsigned long)y : y;
+    assert(x);
+    assert(y != 0);
+    if ((XPW_limb)u == u) {
+	XPW_T q = ALLOC(x->ndigits*sizeof (XPW_limb));
+	XPW_limb r = XPW_quotient(x->ndigits, q, x->digits, u);
+	FREE(q);
+	if (r != 0 && (x->sign < 0) != (y < 0))
+	    r = u - r;
+	rem = (long)r;
+    } else {
+	T r;
+	XPW_limb d[LIMBS(sizeof (unsigned long))];
+	struct T t;
+	t.size = LIMBS(sizeof (unsigned long));
+	t.digits = d;
+	r = AP_mod(x, set(&t, y));
+	rem = XPW_toint(r->ndigits, r->digits);
+	AP_free(&r);
+    }
     return rem;
 }
 
@@ -327,8 +703,8 @@ T AP_lshift(T x, int s) {
     T z;
     assert(x);
     assert(s >= 0);
-    z = mk(x->ndigits + ((s+7)&~7)/8);
-    XP_lshift(z->size, z->digits, x->ndigits,
+    z = mk(x->ndigits + (s + BITS - 1)/BITS);
+    XPW_lshift(z->size, z->digits, x->ndigits,
 	    x->digits, s, 0);
     z->sign = x->sign;
     return normalize(z, z->size);
@@ -337,11 +713,11 @@ T AP_lshift(T x, int s) {
 T AP_rshift(T x, int s) {
     assert(x);
     assert(s >= 0);
-    if (s >= 8*x->ndigits)
+    if (s >= BITS*x->ndigits)
 	return AP_new(0);
     else {
-	T z = mk(x->ndigits - s/8);
-	XP_rshift(z->size, z->digits, x->ndigits,
+	T z = mk(x->ndigits - s/BITS);
+	XPW_rshift(z->size, z->digits, x->ndigits,
 		x->digits, s, 0);
 	normalize(z, z->size);
 	z->sign = iszero(z) ? 1 : x->sign;
@@ -352,7 +728,7 @@ T AP_rshift(T x, int s) {
 long int AP_toint(T x) {
     unsigned long u;
     assert(x);
-    u = XP_toint(x->ndigits, x->digits)%(LONG_MAX + 1UL);
+    u = XPW_toint(x->ndigits, x->digits)%(LONG_MAX + 1UL);
     if (x->sign == -1)
 	return -(long)u;
     else
@@ -382,10 +758,10 @@ T AP_fromstr(const char *str, int base, char **end) {
 	    n++;
 	for (k = 1; (1<<k) < base; k++)
 	    ;
-	z = mk(((k*n + 7)&~7)/8);
+	z = mk((k*n + BITS - 1)/BITS > 0 ? (k*n + BITS - 1)/BITS : 1);
 	p = start;
     }
-    carry = XP_fromstr(z->size, z->digits, p,
+    carry = XPW_fromstr(z->size, z->digits, p,
 	    base, &endp);
     assert(carry == 0);
     normalize(z, z->size);
@@ -400,7 +776,7 @@ T AP_fromstr(const char *str, int base, char **end) {
 }
 
 char *AP_tostr(char *str, int size, int base, T x) {
-    XP_T q;
+    XPW_T q;
     assert(x);
     assert(base >= 2 && base <= 36);
     assert(str == NULL || size > 1);
@@ -409,19 +785,19 @@ char *AP_tostr(char *str, int size, int base, T x) {
 	    int k;
 	    for (k = 5; (1<<k) > base; k--)
 		;
-	    size = (8*x->ndigits)/k + 1 + 1;
+	    size = (BITS*x->ndigits)/k + 1 + 1;
 	    if (x->sign == -1)
 		size++;
 	}
 	str = ALLOC(size);
     }
-    q = ALLOC(x->ndigits);
-    memcpy(q, x->digits, x->ndigits);
+    q = ALLOC(x->ndigits*sizeof (XPW_limb));
+    memcpy(q, x->digits, x->ndigits*sizeof (XPW_limb));
     if (x->sign == -1) {
 	str[0] = '-';
-	XP_tostr(str + 1, size - 1, base, x->ndigits, q);
+	XPW_tostr(str + 1, size - 1, base, x->ndigits, q);
     } else
-	XP_tostr(str, size, base, x->ndigits, q);
+	XPW_tostr(str, size, base, x->ndigits, q);
     FREE(q);
     return str;
 }
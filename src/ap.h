@@ -2,6 +2,7 @@
 #define AP_INCLUDED
 
 #include <stdarg.h>
+#include "arena.h"
 #include "fmt.h"
 
 #define T AP_T
@@ -24,6 +25,8 @@ extern void     AP_fmt(int code, va_list_box *box,
 
 extern void AP_free(T *z);
 
+extern Arena_T AP_arena(Arena_T arena);
+
 extern T AP_neg(T x);
 
 extern T AP_add(T x, T y);
@@ -38,6 +41,18 @@ extern T AP_mod(T x, T y);
 
 extern T AP_pow(T x, T y, T p);
 
+extern T AP_gcd(T x, T y);
+
+extern T AP_invmod(T x, T p);
+
+extern T AP_isqrt(T x);
+
+extern T AP_add_into(T z, T x, T y);
+
+extern T AP_sub_into(T z, T x, T y);
+
+extern T AP_mul_into(T z, T x, T y);
+
 extern T AP_addi(T x, long int y);
 
 extern T AP_subi(T x, long int y);
@@ -48,6 +63,12 @@ extern T AP_divi(T x, long int y);
 
 extern long AP_modi(T x, long int y);
 
+extern T AP_addi_into(T z, T x, long int y);
+
+extern T AP_subi_into(T z, T x, long int y);
+
+extern T AP_muli_into(T z, T x, long int y);
+
 extern T AP_lshift(T x, int s);
 
 extern T AP_rshift(T x, int s);
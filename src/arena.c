@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "assert.h"
 #include "except.h"
 #include "arena.h"
@@ -42,6 +43,8 @@ static T freechunks;
 
 static int nfree;
 
+static pthread_mutex_t freelock = PTHREAD_MUTEX_INITIALIZER;
+
 T Arena_new(void) {
     T arena = malloc(sizeof (*arena));
     if (arena == NULL)
@@ -67,11 +70,14 @@ void *Arena_alloc(T arena, long nbytes,
     while (nbytes > arena->limit - arena->avail) {
 	T ptr;
 	char *limit;
+	pthread_mutex_lock(&freelock);
 	if ((ptr = freechunks) != NULL) {
 	    freechunks = freechunks->prev;
 	    nfree--;
-	    limit = ptr->limit;
 	}
+	pthread_mutex_unlock(&freelock);
+	if (ptr != NULL)
+	    limit = ptr->limit;
 	else {
 	    long m = sizeof (union header) + nbytes + 10*1024;
 		ptr = malloc(m);
@@ -105,15 +111,18 @@ void Arena_free(T arena) {
     assert(arena);
     while (arena->prev) {
 	struct T tmp = *arena->prev;
+	pthread_mutex_lock(&freelock);
 	if (nfree < THRESHOLD) {
 	    arena->prev->prev = freechunks;
 	    freechunks = arena->prev;
 	    nfree++;
 	    freechunks->limit = arena->limit;
+	    arena->prev = NULL;
 	}
-	else
+	pthread_mutex_unlock(&freelock);
+	if (arena->prev)
 	    free(arena->prev);
-	    *arena = tmp;
+	*arena = tmp;
     }
     assert(arena->limit == NULL);
     assert(arena->avail == NULL);
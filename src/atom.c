@@ -2,62 +2,208 @@
 #include <string.h>
 #include "assert.h"
 #include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "arena.h"
 #include "mem.h"
 
-#define NELEMS(x) ((sizeof (x))/(sizeof ((x)[0])))
+#define NSTRIPES 64
 
-static struct atom {
-    struct atom *link;
+struct atom {
+    struct atom *_Atomic link;
+    unsigned long hash;
     int len;
     char *str;
-} *buckets[2048];
-
-static unsigned long scatter[] = {
-    2078917053, 143302914, 1027100827, 1953210302, 755253631, 2002600785,
-    1405390230, 45248011, 1099951567, 433832350, 2018585307, 438263339,
-    813528929, 1703199216, 618906479, 573714703, 766270699, 275680090,
-    1510320440, 1583583926, 1723401032, 1965443329, 1098183682, 1636505764,
-    980071615, 1011597961, 643279273, 1315461275, 157584038, 1069844923,
-    471560540, 89017443, 1213147837, 1498661368, 2042227746, 1968401469,
-    1353778505, 1300134328, 2013649480, 306246424, 1733966678, 1884751139,
-    744509763, 400011959, 1440466707, 1363416242, 973726663, 59253759,
-    1639096332, 336563455, 1642837685, 1215013716, 154523136, 593537720,
-    704035832, 1134594751, 1605135681, 1347315106, 302572379, 1762719719,
-    269676381, 774132919, 1851737163, 1482824219, 125310639, 1746481261,
-    1303742040, 1479089144, 899131941, 1169907872, 1785335569, 485614972,
-    907175364, 382361684, 885626931, 200158423, 1745777927, 1859353594,
-    259412182, 1237390611, 48433401, 1902249868, 304920680, 202956538,
-    348303940, 1008956512, 1337551289, 1953439621, 208787970, 1640123668,
-    1568675693, 478464352, 266772940, 1272929208, 1961288571, 392083579,
-    871926821, 1117546963, 1871172724, 1771058762, 139971187, 1509024645,
-    109190086, 1047146551, 1891386329, 994817018, 1247304975, 1489680608,
-    706686964, 1506717157, 579587572, 755120366, 1261483377, 884508252,
-    958076904, 1609787317, 1893464764, 148144545, 1415743291, 2102252735,
-    1788268214, 836935336, 433233439, 2055041154, 2109864544, 247038362,
-    299641085, 834307717, 1364585325, 23330161, 457882831, 1504556512,
-    1532354806, 567072918, 404219416, 1276257488, 1561889936, 1651524391,
-    618454448, 121093252, 1010757900, 1198042020, 876213618, 124757630,
-    2082550272, 1834290522, 1734544947, 1828531389, 1982435068, 1002804590,
-    1783300476, 1623219634, 1839739926, 69050267, 1530777140, 1802120822,
-    316088629, 1830418225, 488944891, 1680673954, 1853748387, 946827723,
-    1037746818, 1238619545, 1513900641, 1441966234, 367393385, 928306929,
-    946006977, 985847834, 1049400181, 1956764878, 36406206, 1925613800,
-    2081522508, 2118956479, 1612420674, 1668583807, 1800004220, 1447372094,
-    523904750, 1435821048, 923108080, 216161028, 1504871315, 306401572,
-    2018281851, 1820959944, 2136819798, 359743094, 1354150250, 1843084537,
-    1306570817, 244413420, 934220434, 672987810, 1686379655, 1301613820,
-    1601294739, 484902984, 139978006, 503211273, 294184214, 176384212,
-    281341425, 228223074, 147857043, 1893762099, 1896806882, 1947861263,
-    1193650546, 273227984, 1236198663, 2116758626, 489389012, 593586330,
-    275676551, 360187215, 267062626, 265012701, 719930310, 1621212876,
-    2108097238, 2026501127, 1865626297, 894834024, 552005290, 1404522304,
-    48964196, 5816381, 1889425288, 188942202, 509027654, 36125855,
-    365326415, 790369079, 264348929, 513183458, 536647531, 13672163,
-    313561074, 1730298077, 286900147, 1549759737, 1699573055, 776289160,
-    2143346068, 1975249606, 1136476375, 262925046, 92778659, 1856406685,
-    1884137923, 53392249, 1735424165, 1602280572
 };
 
+static struct atom *_Atomic initbuckets[2048];
+
+static struct table {
+    long size;
+    struct atom *_Atomic *buckets;
+    struct table *retired;
+} initial = { 2048, initbuckets, NULL };
+
+static _Atomic(struct table *) current = &initial;
+
+static pthread_mutex_t stripes[NSTRIPES];
+
+static long counts[NSTRIPES];
+
+static struct pool {
+    struct pool *link;
+    Arena_T arena;
+} *pools;
+
+static pthread_mutex_t poollock = PTHREAD_MUTEX_INITIALIZER;
+
+static _Thread_local Arena_T arena;
+
+static _Thread_local struct gen {
+    struct gen *prev;
+    Arena_T arena;
+    long size;
+    long count;
+    struct atom **buckets;
+} *gens;
+
+static _Thread_local int depth;
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+static void initstripes(void) {
+    int i;
+    for (i = 0; i < NSTRIPES; i++)
+	pthread_mutex_init(&stripes[i], NULL);
+}
+
+static uint64_t read64(const char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static uint64_t mum(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+    __extension__ unsigned __int128 r = (unsigned __int128)a*b;
+    return (uint64_t)r^(uint64_t)(r>>64);
+#else
+    uint64_t ha = a>>32, la = (uint32_t)a, hb = b>>32, lb = (uint32_t)b;
+    uint64_t rh = ha*hb, rm0 = ha*lb, rm1 = hb*la, rl = la*lb;
+    uint64_t t = rl + (rm0<<32), lo, c = t < rl;
+    lo = t + (rm1<<32);
+    c += lo < t;
+    return lo^(rh + (rm0>>32) + (rm1>>32) + c);
+#endif
+}
+
+static unsigned long hash(const char *str, int len) {
+    static const uint64_t k0 = 0xa0761d6478bd642fULL,
+	k1 = 0xe7037ed1a0b428dbULL, k2 = 0x8ebc6af09c88c6e3ULL;
+    uint64_t h = k0^len, tail = 0;
+    for ( ; len >= 16; str += 16, len -= 16)
+	h = mum(read64(str)^k1, read64(str + 8)^h);
+    if (len >= 8) {
+	h = mum(read64(str)^k1, h^k2);
+	str += 8;
+	len -= 8;
+    }
+    memcpy(&tail, str, len);
+    return mum(tail^k1, h^k2);
+}
+
+static struct atom *find(struct atom *p, struct atom *end,
+    unsigned long h, const char *str, int len) {
+    for ( ; p != end; p = atomic_load_explicit(&p->link, memory_order_acquire))
+	if (h == p->hash && len == p->len && memcmp(p->str, str, len) == 0)
+	    return p;
+    return NULL;
+}
+
+static void lockall(void) {
+    int i;
+    for (i = 0; i < NSTRIPES; i++)
+	pthread_mutex_lock(&stripes[i]);
+}
+
+static void unlockall(void) {
+    int i;
+    for (i = NSTRIPES - 1; i >= 0; i--)
+	pthread_mutex_unlock(&stripes[i]);
+}
+
+static void grow(struct table *t) {
+    long i;
+    struct table *new;
+    NEW(new);
+    new->size = 2*t->size;
+    new->buckets = CALLOC(new->size, sizeof (new->buckets[0]));
+    lockall();
+    if (atomic_load_explicit(&current, memory_order_relaxed) != t) {
+	unlockall();
+	FREE(new->buckets);
+	FREE(new);
+	return;
+    }
+    for (i = 0; i < t->size; i++) {
+	struct atom *p, *q;
+	p = atomic_load_explicit(&t->buckets[i], memory_order_relaxed);
+	for ( ; p; p = q) {
+	    long j = p->hash&(new->size - 1);
+	    q = atomic_load_explicit(&p->link, memory_order_relaxed);
+	    atomic_store_explicit(&p->link,
+		atomic_load_explicit(&new->buckets[j], memory_order_relaxed),
+		memory_order_release);
+	    atomic_store_explicit(&new->buckets[j], p, memory_order_release);
+	}
+    }
+    new->retired = t;
+    atomic_store_explicit(&current, new, memory_order_release);
+    unlockall();
+}
+
+static struct atom *mkatom(Arena_T arena, unsigned long h,
+    const char *str, int len) {
+    struct atom *p = Arena_alloc(arena, sizeof (*p) + len + 1,
+	__FILE__, __LINE__);
+    p->hash = h;
+    p->len = len;
+    p->str = (char *)(p + 1);
+    if (len > 0)
+	memcpy(p->str, str, len);
+    p->str[len] = '\0';
+    return p;
+}
+
+static Arena_T threadarena(void) {
+    if (arena == NULL) {
+	struct pool *p;
+	NEW(p);
+	p->arena = Arena_new();
+	pthread_mutex_lock(&poollock);
+	p->link = pools;
+	pools = p;
+	pthread_mutex_unlock(&poollock);
+	arena = p->arena;
+    }
+    return arena;
+}
+
+static struct atom *genfind(unsigned long h, const char *str, int len) {
+    struct gen *g;
+    struct atom *p;
+    for (g = gens; g; g = g->prev)
+	if ((p = find(g->buckets[h&(g->size - 1)], NULL, h, str, len)) != NULL)
+	    return p;
+    return NULL;
+}
+
+static struct atom *genput(struct gen *g, unsigned long h,
+    const char *str, int len) {
+    struct atom *p = mkatom(g->arena, h, str, len);
+    if (++g->count > g->size) {
+	long i, size = 2*g->size;
+	struct atom **buckets = Arena_calloc(g->arena, size,
+	    sizeof (buckets[0]), __FILE__, __LINE__);
+	for (i = 0; i < g->size; i++) {
+	    struct atom *q, *next;
+	    for (q = g->buckets[i]; q; q = next) {
+		next = atomic_load_explicit(&q->link, memory_order_relaxed);
+		atomic_store_explicit(&q->link, buckets[q->hash&(size - 1)],
+		    memory_order_relaxed);
+		buckets[q->hash&(size - 1)] = q;
+	    }
+	}
+	g->size = size;
+	g->buckets = buckets;
+    }
+    atomic_store_explicit(&p->link, g->buckets[h&(g->size - 1)],
+	memory_order_relaxed);
+    g->buckets[h&(g->size - 1)] = p;
+    return p;
+}
+
 const char *Atom_string(const char *str) {
     assert(str);
     return Atom_new(str, strlen(str));
@@ -83,39 +229,132 @@ const char *Atom_int(long n) {
 
 const char *Atom_new(const char *str, int len) {
     unsigned long h;
-    int i;
-    struct atom *p;
+    int s, full = 0;
+    struct table *t;
+    struct atom *p, *q, *head;
     assert(str);
     assert(len >= 0);
-    for (h = 0, i = 0; i < len; i++)
-	h = (h<<1) + scatter[(unsigned char)str[i]];
-    h &= NELEMS(buckets)-1;
-    for (p = buckets[h]; p; p = p->link)
-	if (len == p->len) {
-	    for (i = 0; i < len && p->str[i] == str[i];)
-		i++;
-		if (i == len)
-		    return p->str;
-	}
-    p = ALLOC(sizeof (*p) + len + 1);
-    p->len = len;
-    p->str = (char *)(p + 1);
-    if (len > 0)
-	memcpy(p->str, str, len);
-    p->str[len] = '\0';
-    p->link = buckets[h];
-    buckets[h] = p;
+    pthread_once(&once, initstripes);
+    h = hash(str, len);
+    if (gens && (p = genfind(h, str, len)) != NULL)
+	return p->str;
+    t = atomic_load_explicit(&current, memory_order_acquire);
+    head = atomic_load_explicit(&t->buckets[h&(t->size - 1)],
+	memory_order_acquire);
+    if ((p = find(head, NULL, h, str, len)) != NULL)
+	return p->str;
+    if (gens)
+	return genput(gens, h, str, len)->str;
+    q = mkatom(threadarena(), h, str, len);
+    s = h%NSTRIPES;
+    pthread_mutex_lock(&stripes[s]);
+    if (atomic_load_explicit(&current, memory_order_relaxed) != t) {
+	t = atomic_load_explicit(&current, memory_order_relaxed);
+	head = NULL;
+    }
+    p = atomic_load_explicit(&t->buckets[h&(t->size - 1)],
+	memory_order_relaxed);
+    atomic_store_explicit(&q->link, p, memory_order_relaxed);
+    if ((p = find(p, head, h, str, len)) == NULL) {
+	atomic_store_explicit(&t->buckets[h&(t->size - 1)], q,
+	    memory_order_release);
+	p = q;
+	full = ++counts[s] > t->size/NSTRIPES;
+    }
+    pthread_mutex_unlock(&stripes[s]);
+    if (full)
+	grow(t);
     return p->str;
 }
 
+static struct atom *header(const char *str) {
+    struct atom *p = (struct atom *)str - 1;
+    assert(p->str == str);
+    return p;
+}
+
 int Atom_length(const char *str) {
-    struct atom *p;
-    int i;
     assert(str);
-    for (i = 0; i < NELEMS(buckets); i++)
-	for (p = buckets[i]; p; p = p->link)
-	    if (p->str == str)
-		return p->len;
-    assert(0);
-    return 0;
+    return header(str)->len;
+}
+
+unsigned long Atom_hash(const char *str) {
+    assert(str);
+    return header(str)->hash;
+}
+
+void Atom_stats(Atom_Stats *stats) {
+    long i;
+    struct table *t;
+    assert(stats);
+    pthread_once(&once, initstripes);
+    lockall();
+    t = atomic_load_explicit(&current, memory_order_relaxed);
+    stats->atoms = stats->used = stats->maxchain = 0;
+    stats->buckets = t->size;
+    stats->probes = 0;
+    for (i = 0; i < t->size; i++) {
+	long n = 0;
+	struct atom *p;
+	for (p = atomic_load_explicit(&t->buckets[i], memory_order_relaxed);
+	    p; p = atomic_load_explicit(&p->link, memory_order_relaxed))
+	    stats->probes += ++n;
+	if (n > 0)
+	    stats->used++;
+	if (n > stats->maxchain)
+	    stats->maxchain = n;
+	stats->atoms += n;
+    }
+    unlockall();
+    stats->avgchain = stats->used ? (double)stats->atoms/stats->used : 0;
+    stats->probes = stats->atoms ? stats->probes/stats->atoms : 0;
+}
+
+void Atom_reset(void) {
+    long i;
+    struct table *t, *r;
+    struct pool *p;
+    assert(gens == NULL);
+    pthread_once(&once, initstripes);
+    lockall();
+    t = atomic_load_explicit(&current, memory_order_relaxed);
+    for (i = 0; i < t->size; i++)
+	atomic_store_explicit(&t->buckets[i], NULL, memory_order_relaxed);
+    for (r = t->retired; r; r = t->retired) {
+	t->retired = r->retired;
+	if (r != &initial) {
+	    FREE(r->buckets);
+	    FREE(r);
+	}
+    }
+    for (i = 0; i < NSTRIPES; i++)
+	counts[i] = 0;
+    pthread_mutex_lock(&poollock);
+    for (p = pools; p; p = p->link)
+	Arena_free(p->arena);
+    pthread_mutex_unlock(&poollock);
+    unlockall();
+}
+
+int Atom_begin(void) {
+    Arena_T arena = Arena_new();
+    struct gen *g = Arena_alloc(arena, sizeof (*g), __FILE__, __LINE__);
+    g->arena = arena;
+    g->size = 64;
+    g->count = 0;
+    g->buckets = Arena_calloc(arena, g->size, sizeof (g->buckets[0]),
+	__FILE__, __LINE__);
+    g->prev = gens;
+    gens = g;
+    return ++depth;
+}
+
+void Atom_end(int gen) {
+    Arena_T arena;
+    assert(gens);
+    assert(gen == depth);
+    arena = gens->arena;
+    gens = gens->prev;
+    depth--;
+    Arena_dispose(&arena);
 }
@@ -1,12 +1,40 @@
 #ifndef ATOM_INCLUDED
 #define ATOM_INCLUDED
 
+typedef struct Atom_Stats {
+    long atoms;
+    long buckets;
+    long used;
+    long maxchain;
+    double avgchain;
+    double probes;
+} Atom_Stats;
+
 extern int Atom_length (const char *str);
 
+extern unsigned long Atom_hash (const char *str);
+
 extern const char *Atom_new (const char *str, int len);
 
 extern const char *Atom_string (const char *str);
 
 extern const char *Atom_int (long n);
 
+extern void Atom_stats(Atom_Stats *stats);
+
+extern void Atom_reset(void);
+
+/*
+ * Atoms created while a generation is open belong to the calling
+ * thread and die at the matching Atom_end. A string that was already
+ * an atom keeps its shared atom, but one first interned inside a
+ * generation gets a private atom, and other threads (or the same
+ * thread after Atom_end) get a different one for the same string.
+ * Compare a generation atom only with atoms the same thread obtained
+ * while that generation was open.
+ */
+extern int Atom_begin(void);
+
+extern void Atom_end(int gen);
+
 #endif
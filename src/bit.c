@@ -1,51 +1,224 @@
+#define _POSIX_C_SOURCE 200809L
+#include <limits.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "assert.h"
 #include "bit.h"
 #include "mem.h"
+#include "pool.h"
+#if defined(__GNUC__) && defined(__x86_64__) && __SIZEOF_LONG__ == 8
+#define AVX2 1
+#include <immintrin.h>
+#endif
 
 #define T Bit_T
 
 struct T {
     int length;
-    unsigned char *bytes;
     unsigned long *words;
+    int *ranks;
+    int *samples;
+    void *map;
+    size_t mapsize;
 };
 
+struct header {
+    char magic[8];
+    long length;
+    long reserved[6];
+};
+
+struct chunk {
+    const unsigned long *words;
+    int n;
+    atomic_int *total;
+};
+
+static const char magic[8] = "CIIBIT1";
+
+const Except_T Bit_Failed = { "Bit file mapping failed" };
+
 #define BPW (8*sizeof (unsigned long))
 
 #define nwords(len) ((((len) + BPW - 1)&(~(BPW-1)))/BPW)
 
-#define nbytes(len) ((((len) + 8 - 1)&(~(8-1)))/8)
+#define BLOCK 8
 
-#define setop(sequal, snull, tnull, op) \
+#define CHUNK 65536
+
+#define SAMPLE 512
+
+#define nblocks(len) ((nwords(len) + BLOCK - 1)/BLOCK)
+
+#define stale(set) do { if ((set)->ranks) { \
+	FREE((set)->ranks); (set)->samples = NULL; } } while (0)
+
+#ifdef AVX2
+#define dispatch(kernel, z, x, y, n) \
+    (__builtin_cpu_supports("avx2") ? kernel##_avx2(z, x, y, n) \
+	: kernel(z, x, y, n))
+#else
+#define dispatch(kernel, z, x, y, n) kernel(z, x, y, n)
+#endif
+
+#define setop(sequal, snull, tnull, kernel) \
     if (s == t) { assert(s); return sequal; } \
     else if (s == NULL) { assert(t); return snull; } \
     else if (t == NULL) return tnull; \
     else { \
-	int i; T set; \
+	T set; \
 	assert(s->length == t->length); \
-	set = Bit_new(s->length); \
-	for (i = nwords(s->length); --i >= 0; ) \
-	set->words[i] = s->words[i] op t->words[i]; \
+	set = mk(s->length); \
+	dispatch(kernel, set->words, s->words, t->words, \
+	    nwords(s->length)); \
 	return set; }
 
-unsigned char msbmask[] = {
-    0xFF, 0xFE, 0xFC, 0xF8,
-    0xF0, 0xE0, 0xC0, 0x80
-};
+#define kernel(name, op) \
+static void name(unsigned long *z, const unsigned long *x, \
+	const unsigned long *y, int n) { \
+    int i; \
+    for (i = 0; i < n; i++) \
+	z[i] = x[i] op y[i]; \
+}
 
-unsigned char lsbmask[] = {
-    0x01, 0x03, 0x07, 0x0F,
-    0x1F, 0x3F, 0x7F, 0xFF
-};
+#define kernel_avx2(name, op, vop) \
+__attribute__((target("avx2"))) \
+static void name##_avx2(unsigned long *z, const unsigned long *x, \
+	const unsigned long *y, int n) { \
+    int i; \
+    for (i = 0; i + 4 <= n; i += 4) { \
+	__m256i a = _mm256_loadu_si256((const __m256i *)&x[i]), \
+	    b = _mm256_loadu_si256((const __m256i *)&y[i]); \
+	_mm256_storeu_si256((__m256i *)&z[i], vop); \
+    } \
+    for ( ; i < n; i++) \
+	z[i] = x[i] op y[i]; \
+}
+
+kernel(or, |)
+kernel(and, &)
+kernel(andnot, & ~)
+kernel(xor, ^)
+
+#ifdef AVX2
+kernel_avx2(or, |, _mm256_or_si256(a, b))
+kernel_avx2(and, &, _mm256_and_si256(a, b))
+kernel_avx2(andnot, & ~, _mm256_andnot_si256(b, a))
+kernel_avx2(xor, ^, _mm256_xor_si256(a, b))
+#endif
+
+static int pop(unsigned long x) {
+#ifdef __GNUC__
+    return __builtin_popcountl(x);
+#else
+    int n;
+    for (n = 0; x; n++)
+	x &= x - 1;
+    return n;
+#endif
+}
+
+static int ctz(unsigned long x) {
+#ifdef __GNUC__
+    return __builtin_ctzl(x);
+#else
+    int n;
+    for (n = 0; (x&1) == 0; n++)
+	x >>= 1;
+    return n;
+#endif
+}
+
+static int selectword(unsigned long x, int k) {
+    int i = 0, c;
+    for ( ; k >= (c = pop(x&0xFF)); i += 8, x >>= 8)
+	k -= c;
+    for ( ; k > 0; k--)
+	x &= x - 1;
+    return i + ctz(x);
+}
+
+static int count(const unsigned long *w, int n) {
+    int i, c = 0;
+    for (i = 0; i < n; i++)
+	c += pop(w[i]);
+    return c;
+}
+
+#ifdef AVX2
+__attribute__((target("popcnt")))
+static int count_popcnt(const unsigned long *w, int n) {
+    int i, c = 0;
+    for (i = 0; i < n; i++)
+	c += __builtin_popcountl(w[i]);
+    return c;
+}
+
+__attribute__((target("avx2,popcnt")))
+static int count_avx2(const unsigned long *w, int n) {
+    const __m256i lookup = _mm256_setr_epi8(
+	0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+	0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4),
+	low = _mm256_set1_epi8(0x0F);
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0, c = 0;
+    while (i + 4 <= n) {
+	__m256i sum = _mm256_setzero_si256();
+	int j;
+	for (j = 0; j < 31 && i + 4 <= n; j++, i += 4) {
+	    __m256i v = _mm256_loadu_si256((const __m256i *)&w[i]);
+	    sum = _mm256_add_epi8(sum, _mm256_add_epi8(
+		_mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low)),
+		_mm256_shuffle_epi8(lookup,
+		    _mm256_and_si256(_mm256_srli_epi16(v, 4), low))));
+	}
+	acc = _mm256_add_epi64(acc,
+	    _mm256_sad_epu8(sum, _mm256_setzero_si256()));
+    }
+    c = _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1)
+	+ _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3);
+    for ( ; i < n; i++)
+	c += __builtin_popcountl(w[i]);
+    return c;
+}
+#endif
+
+static int popcount(const unsigned long *w, int n) {
+#ifdef AVX2
+    if (__builtin_cpu_supports("avx2"))
+	return count_avx2(w, n);
+    if (__builtin_cpu_supports("popcnt"))
+	return count_popcnt(w, n);
+#endif
+    return count(w, n);
+}
+
+static T mk(int length) {
+    T set;
+    NEW(set);
+    if (length > 0)
+	set->words = ALLOC(nwords(length)*sizeof (unsigned long));
+    else
+	set->words = NULL;
+    set->length = length;
+    set->ranks = NULL;
+    set->samples = NULL;
+    set->map = NULL;
+    return set;
+}
 
 static T copy(T t) {
     T set;
     assert(t);
-    set = Bit_new(t->length);
+    set = mk(t->length);
     if (t->length > 0)
-	memcpy(set->bytes, t->bytes, nbytes(t->length));
+	memcpy(set->words, t->words,
+	    nwords(t->length)*sizeof (unsigned long));
     return set;
 }
 
@@ -58,14 +231,79 @@ T Bit_new(int length) {
 		sizeof (unsigned long));
     else
 	set->words = NULL;
-    set->bytes = (unsigned char *)set->words;
     set->length = length;
+    set->ranks = NULL;
+    set->samples = NULL;
+    set->map = NULL;
+    return set;
+}
+
+T Bit_open(const char *path, int length) {
+    T set;
+    int fd;
+    struct stat st;
+    struct header *h;
+    size_t size;
+    void *map;
+    assert(path);
+    if ((fd = open(path, O_RDWR | O_CREAT, 0666)) < 0)
+	RAISE(Bit_Failed);
+    if (fstat(fd, &st) < 0) {
+	close(fd);
+	RAISE(Bit_Failed);
+    }
+    if (st.st_size == 0) {
+	size = sizeof *h + nwords(length)*sizeof (unsigned long);
+	if (length < 0 || ftruncate(fd, size) < 0) {
+	    close(fd);
+	    RAISE(Bit_Failed);
+	}
+    } else
+	size = st.st_size;
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+	RAISE(Bit_Failed);
+    h = map;
+    if (st.st_size == 0) {
+	memcpy(h->magic, magic, sizeof magic);
+	h->length = length;
+    } else if (size < sizeof *h || memcmp(h->magic, magic, sizeof magic) != 0
+    || h->length < 0 || h->length > INT_MAX
+    || (length >= 0 && h->length != length)
+    || size < sizeof *h + nwords(h->length)*sizeof (unsigned long)) {
+	munmap(map, size);
+	RAISE(Bit_Failed);
+    }
+    NEW(set);
+    set->length = h->length;
+    set->words = (unsigned long *)(h + 1);
+    set->ranks = NULL;
+    set->samples = NULL;
+    set->map = map;
+    set->mapsize = size;
     return set;
 }
 
+void Bit_sync(T set) {
+    assert(set);
+    if (set->map && msync(set->map, set->mapsize, MS_SYNC) < 0)
+	RAISE(Bit_Failed);
+}
+
+void Bit_close(T *set) {
+    assert(set && *set);
+    Bit_sync(*set);
+    Bit_free(set);
+}
+
 void Bit_free(T *set) {
     assert(set && *set);
-    FREE((*set)->words);
+    stale(*set);
+    if ((*set)->map)
+	munmap((*set)->map, (*set)->mapsize);
+    else
+	FREE((*set)->words);
     FREE(*set);
 }
 
@@ -75,21 +313,40 @@ int Bit_length(T set) {
 }
 
 int Bit_count(T set) {
-    int length = 0, n;
-    static char count[] = {
-	0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4 };
     assert(set);
-    for (n = nbytes(set->length); --n >= 0; ) {
-	unsigned char c = set->bytes[n];
-	length += count[c&0xF] + count[c>>4];
+    return popcount(set->words, nwords(set->length));
+}
+
+static int countchunk(void *cl) {
+    struct chunk *c = cl;
+    atomic_fetch_add_explicit(c->total, popcount(c->words, c->n),
+	memory_order_relaxed);
+    return 0;
+}
+
+int Bit_parallel_count(T set, Pool_T pool) {
+    int i, n;
+    atomic_int total;
+    assert(set);
+    if (pool == NULL)
+	return Bit_count(set);
+    atomic_init(&total, 0);
+    n = nwords(set->length);
+    for (i = 0; i < n; i += CHUNK) {
+	struct chunk c;
+	c.words = &set->words[i];
+	c.n = n - i < CHUNK ? n - i : CHUNK;
+	c.total = &total;
+	Pool_spawn(pool, countchunk, &c, sizeof c);
     }
-    return length;
+    Pool_sync(pool);
+    return atomic_load(&total);
 }
 
 int Bit_get(T set, int n) {
     assert(set);
     assert(0 <= n && n < set->length);
-    return ((set->bytes[n/8]>>(n%8))&1);
+    return ((set->words[n/BPW]>>(n%BPW))&1);
 }
 
 int Bit_put(T set, int n, int bit) {
@@ -97,59 +354,87 @@ int Bit_put(T set, int n, int bit) {
     assert(set);
     assert(bit == 0 || bit == 1);
     assert(0 <= n && n < set->length);
-    prev = ((set->bytes[n/8]>>(n%8))&1);
+    prev = ((set->words[n/BPW]>>(n%BPW))&1);
+    stale(set);
     if (bit == 1)
-	set->bytes[n/8] |=   1<<(n%8);
+	set->words[n/BPW] |=   1UL<<(n%BPW);
     else
-	set->bytes[n/8] &= ~(1<<(n%8));
+	set->words[n/BPW] &= ~(1UL<<(n%BPW));
     return prev;
 }
 
+int Bit_test_and_set(T set, int n) {
+    assert(set);
+    assert(set->ranks == NULL);
+    assert(0 <= n && n < set->length);
+    return (__atomic_fetch_or(&set->words[n/BPW], 1UL<<(n%BPW),
+	__ATOMIC_ACQ_REL)>>(n%BPW))&1;
+}
+
+int Bit_atomic_clear(T set, int n) {
+    assert(set);
+    assert(set->ranks == NULL);
+    assert(0 <= n && n < set->length);
+    return (__atomic_fetch_and(&set->words[n/BPW], ~(1UL<<(n%BPW)),
+	__ATOMIC_ACQ_REL)>>(n%BPW))&1;
+}
+
+int Bit_atomic_put(T set, int n, int bit) {
+    assert(bit == 0 || bit == 1);
+    if (bit == 1)
+	return Bit_test_and_set(set, n);
+    else
+	return Bit_atomic_clear(set, n);
+}
+
+#define msbmask(n) (~0UL<<((n)%BPW))
+
+#define lsbmask(n) (~0UL>>(BPW - 1 - (n)%BPW))
+
 void Bit_set(T set, int lo, int hi) {
     assert(set);
     assert(0 <= lo && hi < set->length);
     assert(lo <= hi);
-    if (lo/8 < hi/8) {
-	set->bytes[lo/8] |= msbmask[lo%8];
-	{
-	    int i;
-	    for (i = lo/8+1; i < hi/8; i++)
-		set->bytes[i] = 0xFF;
-	}
-	set->bytes[hi/8] |= lsbmask[hi%8];
+    stale(set);
+    if (lo/BPW < hi/BPW) {
+	set->words[lo/BPW] |= msbmask(lo);
+	memset(&set->words[lo/BPW+1], 0xFF,
+	    (hi/BPW - lo/BPW - 1)*sizeof (unsigned long));
+	set->words[hi/BPW] |= lsbmask(hi);
     }
     else
-	set->bytes[lo/8] |= (msbmask[lo%8]&lsbmask[hi%8]);
+	set->words[lo/BPW] |= (msbmask(lo)&lsbmask(hi));
 }
 
 void Bit_clear(T set, int lo, int hi) {
     assert(set);
     assert(0 <= lo && hi < set->length);
     assert(lo <= hi);
-    if (lo/8 < hi/8) {
-	int i;
-	set->bytes[lo/8] &= ~msbmask[lo%8];
-	for (i = lo/8+1; i < hi/8; i++)
-	    set->bytes[i] = 0;
-	set->bytes[hi/8] &= ~lsbmask[hi%8];
+    stale(set);
+    if (lo/BPW < hi/BPW) {
+	set->words[lo/BPW] &= ~msbmask(lo);
+	memset(&set->words[lo/BPW+1], 0,
+	    (hi/BPW - lo/BPW - 1)*sizeof (unsigned long));
+	set->words[hi/BPW] &= ~lsbmask(hi);
     }
     else
-	set->bytes[lo/8] &= ~(msbmask[lo%8]&lsbmask[hi%8]);
+	set->words[lo/BPW] &= ~(msbmask(lo)&lsbmask(hi));
 }
 
 void Bit_not(T set, int lo, int hi) {
     assert(set);
     assert(0 <= lo && hi < set->length);
     assert(lo <= hi);
-    if (lo/8 < hi/8) {
+    stale(set);
+    if (lo/BPW < hi/BPW) {
 	int i;
-	set->bytes[lo/8] ^= msbmask[lo%8];
-	for (i = lo/8+1; i < hi/8; i++)
-	    set->bytes[i] ^= 0xFF;
-	set->bytes[hi/8] ^= lsbmask[hi%8];
+	set->words[lo/BPW] ^= msbmask(lo);
+	for (i = lo/BPW+1; i < hi/BPW; i++)
+	    set->words[i] = ~set->words[i];
+	set->words[hi/BPW] ^= lsbmask(hi);
     }
     else
-	set->bytes[lo/8] ^= (msbmask[lo%8]&lsbmask[hi%8]);
+	set->words[lo/BPW] ^= (msbmask(lo)&lsbmask(hi));
 }
 
 void Bit_map(T set,
@@ -157,7 +442,120 @@ void Bit_map(T set,
     int n;
     assert(set);
     for (n = 0; n < set->length; n++)
-	apply(n, ((set->bytes[n/8]>>(n%8))&1), cl);
+	apply(n, ((set->words[n/BPW]>>(n%BPW))&1), cl);
+}
+
+int Bit_next_set(T set, int n) {
+    int i;
+    unsigned long w;
+    assert(set);
+    assert(0 <= n && n <= set->length);
+    if (n == set->length)
+	return -1;
+    i = n/BPW;
+    w = set->words[i]&(~0UL<<(n%BPW));
+    while (w == 0)
+	if (++i >= (int)nwords(set->length))
+	    return -1;
+	else
+	    w = set->words[i];
+    return i*BPW + ctz(w);
+}
+
+int Bit_next_clear(T set, int n) {
+    int i;
+    unsigned long w;
+    assert(set);
+    assert(0 <= n && n <= set->length);
+    if (n == set->length)
+	return -1;
+    i = n/BPW;
+    w = ~set->words[i]&(~0UL<<(n%BPW));
+    while (w == 0)
+	if (++i >= (int)nwords(set->length))
+	    return -1;
+	else
+	    w = ~set->words[i];
+    n = i*BPW + ctz(w);
+    return n < set->length ? n : -1;
+}
+
+void Bit_mapset(T set,
+	void apply(int n, void *cl), void *cl) {
+    int i;
+    assert(set);
+    assert(apply);
+    for (i = 0; i < (int)nwords(set->length); i++) {
+	unsigned long w = set->words[i];
+	for ( ; w; w &= w - 1)
+	    apply(i*BPW + ctz(w), cl);
+    }
+}
+
+void Bit_index(T set) {
+    int i, b, c = 0, k = 0, n, m;
+    assert(set);
+    if (set->ranks)
+	return;
+    n = nblocks(set->length);
+    m = Bit_count(set)/SAMPLE + 2;
+    set->ranks = ALLOC((n + 1 + m)*sizeof (int));
+    set->samples = set->ranks + n + 1;
+    for (b = 0; b < n; b++) {
+	set->ranks[b] = c;
+	for (i = b*BLOCK; i < (b + 1)*BLOCK
+	    && i < (int)nwords(set->length); i++)
+	    c += pop(set->words[i]);
+	for ( ; k*SAMPLE < c; k++)
+	    set->samples[k] = b;
+    }
+    set->ranks[n] = c;
+    for ( ; k < m; k++)
+	set->samples[k] = n;
+}
+
+int Bit_rank(T set, int n) {
+    int i, r = 0;
+    assert(set);
+    assert(0 <= n && n <= set->length);
+    if (set->ranks) {
+	r = set->ranks[n/(BLOCK*BPW)];
+	i = n/(BLOCK*BPW)*BLOCK;
+    } else
+	i = 0;
+    for ( ; i < (int)(n/BPW); i++)
+	r += pop(set->words[i]);
+    if (n%BPW)
+	r += pop(set->words[i]&(~0UL>>(BPW - n%BPW)));
+    return r;
+}
+
+int Bit_select(T set, int k) {
+    int i, lo, hi, c;
+    assert(set);
+    assert(k >= 0);
+    if (set->ranks) {
+	if (k >= set->ranks[nblocks(set->length)])
+	    return -1;
+	lo = set->samples[k/SAMPLE];
+	hi = set->samples[k/SAMPLE+1];
+	while (lo < hi) {
+	    int mid = (lo + hi + 1)/2;
+	    if (set->ranks[mid] <= k)
+		lo = mid;
+	    else
+		hi = mid - 1;
+	}
+	k -= set->ranks[lo];
+	i = lo*BLOCK;
+    } else
+	i = 0;
+    for ( ; i < (int)nwords(set->length); i++)
+	if (k < (c = pop(set->words[i])))
+	    return i*BPW + selectword(set->words[i], k);
+	else
+	    k -= c;
+    return -1;
 }
 
 int Bit_eq(T s, T t) {
@@ -193,19 +591,19 @@ int Bit_lt(T s, T t) {
 }
 
 T Bit_union(T s, T t) {
-    setop(copy(t), copy(t), copy(s), |)
+    setop(copy(t), copy(t), copy(s), or)
 }
 
 T Bit_inter(T s, T t) {
     setop(copy(t),
-	    Bit_new(t->length), Bit_new(s->length), &)
+	    Bit_new(t->length), Bit_new(s->length), and)
 }
 
 T Bit_minus(T s, T t) {
     setop(Bit_new(s->length),
-	    Bit_new(t->length), copy(s), & ~)
+	    Bit_new(t->length), copy(s), andnot)
 }
 
 T Bit_diff(T s, T t) {
-    setop(Bit_new(s->length), copy(t), copy(s), ^)
+    setop(Bit_new(s->length), copy(t), copy(s), xor)
 }
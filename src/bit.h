@@ -1,22 +1,42 @@
 #ifndef BIT_INCLUDED
 #define BIT_INCLUDED
 
+#include "except.h"
+
 #define T Bit_T
 
 typedef struct T *T;
 
+struct Pool_T;
+
+extern const Except_T Bit_Failed;
+
 extern T Bit_new(int length);
 
+extern T Bit_open(const char *path, int length);
+
+extern void Bit_sync(T set);
+
+extern void Bit_close(T *set);
+
 extern int Bit_length(T set);
 
 extern int Bit_count(T set);
 
+extern int Bit_parallel_count(T set, struct Pool_T *pool);
+
 extern void Bit_free(T *set);
 
 extern int Bit_get(T set, int n);
 
 extern int Bit_put(T set, int n, int bit);
 
+extern int Bit_test_and_set(T set, int n);
+
+extern int Bit_atomic_put(T set, int n, int bit);
+
+extern int Bit_atomic_clear(T set, int n);
+
 extern void Bit_clear(T set, int lo, int hi);
 
 extern void Bit_set(T set, int lo, int hi);
@@ -31,6 +51,18 @@ extern int Bit_leq(T s, T t);
 
 extern void Bit_map(T set, void apply(int n, int bit, void *cl), void *cl);
 
+extern int Bit_next_set(T set, int n);
+
+extern int Bit_next_clear(T set, int n);
+
+extern void Bit_mapset(T set, void apply(int n, void *cl), void *cl);
+
+extern void Bit_index(T set);
+
+extern int Bit_rank(T set, int n);
+
+extern int Bit_select(T set, int k);
+
 extern T Bit_union(T s, T t);
 
 extern T Bit_inter(T s, T t);
@@ -6,12 +6,12 @@
 
 #define T Except_T
 
-Except_Frame *Except_stack = NULL;
+_Thread_local Except_Frame *Except_stack = NULL;
 
 void Except_raise(const T *e, const char *file, int line) {
-    Except_Frame *p = Except_stack;
+    Except_Frame *p;
     assert(e);
-    if (p == NULL) {
+    if (!Except_installed()) {
 	fprintf(stderr, "Uncaught exception");
 	if (e->reason)
 	    fprintf(stderr, " %s", e->reason);
@@ -23,9 +23,12 @@ void Except_raise(const T *e, const char *file, int line) {
 	fflush(stderr);
 	abort();
     }
+    p = Except_stack;
     p->exception = e;
     p->file = file;
     p->line = line;
     Except_stack = Except_stack->prev;
+    if (p->fast)
+	Except_longjmp(p->env);
     longjmp(p->env, Except_raised);
 }
@@ -17,6 +17,7 @@ struct Except_Frame {
     const char *file;
     int line;
     const T *exception;
+    int fast;
 };
 
 enum {
@@ -26,12 +27,22 @@ enum {
     Except_finalized
 };
 
-extern Except_Frame *Except_stack;
+extern _Thread_local Except_Frame *Except_stack;
 
 extern const Except_T Assert_Failed;
 
 void Except_raise(const T *e, const char *file,int line);
 
+#ifdef __GNUC__
+#define Except_setjmp(env) __builtin_setjmp((void **)(env))
+#define Except_longjmp(env) __builtin_longjmp((void **)(env), 1)
+#else
+#define Except_setjmp(env) setjmp(env)
+#define Except_longjmp(env) longjmp((env), Except_raised)
+#endif
+
+#define Except_installed() (Except_stack != NULL)
+
 #define RAISE(e) Except_raise(&(e), __FILE__, __LINE__)
 
 #define RERAISE Except_raise(Except_frame.exception, \
@@ -39,14 +50,26 @@ void Except_raise(const T *e, const char *file,int line);
 
 #define RETURN switch (Except_stack = Except_stack->prev,0) default: return
 
-#define TRY do { \
+#define Except_enter(quick, jump) do { \
     volatile int Except_flag; \
     Except_Frame Except_frame; \
     Except_frame.prev = Except_stack; \
+    Except_frame.fast = (quick); \
     Except_stack = &Except_frame;  \
-    Except_flag = setjmp(Except_frame.env); \
+    Except_flag = jump(Except_frame.env); \
     if (Except_flag == Except_entered) {
 
+#define TRY Except_enter(0, setjmp)
+
+/*
+ * FAST_TRY saves less state than TRY: under GCC only the frame and
+ * stack pointers and the resume address. After an exception, every
+ * local of the enclosing function that was modified after FAST_TRY
+ * is indeterminate in EXCEPT, ELSE and FINALLY clauses unless it is
+ * declared volatile, even where TRY's setjmp would have kept it.
+ */
+#define FAST_TRY Except_enter(1, Except_setjmp)
+
 #define EXCEPT(e) \
 	if (Except_flag == Except_entered) Except_stack = Except_stack->prev; \
     } else if (Except_frame.exception == &(e)) { \
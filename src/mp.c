@@ -3,132 +3,320 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
 #include "assert.h"
 #include "fmt.h"
 #include "mem.h"
 #include "xp.h"
+#include "xpw.h"
 #include "mp.h"
 
 #define T MP_T
 
-#define sign(x) ((x)[nbytes-1]>>shift)
+#define sign(mp, x) ((x)[(mp)->nbytes-1]>>(mp)->shift)
 
 #define ones(n) (~(~0UL<<(((n)-1)%8+1)))
 
-#define iszero(x) (XP_length(nbytes,(x))==1 && (x)[0]==0)
+#define iszero(mp, x) (XP_length((mp)->nbytes,(x))==1 && (x)[0]==0)
 
 #define BASE (1<<8)
 
+#define LIMBS(n) (((n) + (int)sizeof (XPW_limb) - 1)/(int)sizeof (XPW_limb))
+
 #define bitop(op) \
+    MP_Ctx mp = current(); \
     int i; assert(z); assert(x); assert(y); \
-    for (i = 0; i < nbytes; i++) z[i] = x[i] op y[i]; \
+    for (i = 0; i < mp->nbytes; i++) z[i] = x[i] op y[i]; \
     return z
 
-#define bitopi(op) assert(z); assert(x); \
-    applyu(op, z, x, y); \
+#define bitopi(op) \
+    MP_Ctx mp = current(); \
+    assert(z); assert(x); \
+    applyu(mp, op, z, x, y); \
     return z
 
 #define shft(fill, op) \
+    MP_Ctx mp = current(); \
     assert(x); assert(z); assert(s >= 0); \
-    if (s >= nbits) memset(z, fill, nbytes); \
-    else op(nbytes, z, nbytes, x, s, fill); \
-    z[nbytes-1] &= msb; \
+    if (s >= mp->nbits) memset(z, fill, mp->nbytes); \
+    else op(mp->nbytes, z, mp->nbytes, x, s, fill); \
+    z[mp->nbytes-1] &= mp->msb; \
     return z
 
 const Except_T MP_Dividebyzero = { "Division by zero" };
 
 const Except_T MP_Overflow = { "Overflow" };
 
-static int nbits = 32;
+#if defined(__SIZEOF_INT128__) && defined(__BYTE_ORDER__) \
+    && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define FIXED 1
+
+__extension__ typedef unsigned __int128 u128;
+
+#define wordops(n) \
+static int add##n(T z, T x, T y) { \
+    uint64_t a[n], b[n]; \
+    int i, carry = 0; \
+    memcpy(a, x, sizeof a); memcpy(b, y, sizeof b); \
+    for (i = 0; i < n; i++) { \
+	u128 t = (u128)a[i] + b[i] + carry; \
+	a[i] = (uint64_t)t; carry = (int)(t>>64); } \
+    memcpy(z, a, sizeof a); \
+    return carry; } \
+static int sub##n(T z, T x, T y) { \
+    uint64_t a[n], b[n]; \
+    int i, borrow = 0; \
+    memcpy(a, x, sizeof a); memcpy(b, y, sizeof b); \
+    for (i = 0; i < n; i++) { \
+	u128 t = (u128)a[i] - b[i] - borrow; \
+	a[i] = (uint64_t)t; borrow = (int)(t>>64)&1; } \
+    memcpy(z, a, sizeof a); \
+    return borrow; } \
+static void mul##n(T z, T x, T y) { \
+    uint64_t a[n], b[n], p[2*n]; \
+    int i, j; \
+    memcpy(a, x, sizeof a); memcpy(b, y, sizeof b); \
+    for (i = 0; i < n; i++) { \
+	uint64_t carry = 0; \
+	for (j = 0; j < n; j++) { \
+	    u128 t = (u128)a[i]*b[j] + (i ? p[i+j] : 0) + carry; \
+	    p[i+j] = (uint64_t)t; carry = (uint64_t)(t>>64); } \
+	p[i+n] = carry; } \
+    memcpy(z, p, sizeof p); }
+
+wordops(1)
+wordops(2)
+wordops(4)
+wordops(8)
+
+static const struct fixed {
+    int n;
+    int (*add)(T, T, T);
+    int (*sub)(T, T, T);
+    void (*mul)(T, T, T);
+} widths[] = {
+    { 1, add1, sub1, mul1 },
+    { 2, add2, sub2, mul2 },
+    { 4, add4, sub4, mul4 },
+    { 8, add8, sub8, mul8 }
+};
+#endif
+
+struct MP_Ctx {
+    int nbits, nbytes, shift;
+    unsigned char msb;
+    const struct fixed *fixed;
+    T tmp[4];
+    int nlimbs;
+    XPW_T wtmp;
+    unsigned char temp[16 + 16 + 16 + 2*16+2];
+    XPW_limb wtemp[6*LIMBS(16) + 2];
+};
+
+static _Thread_local struct MP_Ctx local;
+
+static _Thread_local MP_Ctx cur;
+
+static pthread_key_t key;
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+static void resize(MP_Ctx mp, int n) {
+    mp->nbits  = n;
+    mp->nbytes = (n-1)/8 + 1;
+    mp->shift  = (n-1)%8;
+    mp->msb    = ones(n);
+    if (mp->tmp[0] != mp->temp)
+	FREE(mp->tmp[0]);
+    if (mp->nbytes <= 16)
+	mp->tmp[0] = mp->temp;
+    else
+	mp->tmp[0] = ALLOC(3*mp->nbytes + 2*mp->nbytes + 2);
+    mp->tmp[1] = mp->tmp[0] + 1*mp->nbytes;
+    mp->tmp[2] = mp->tmp[0] + 2*mp->nbytes;
+    mp->tmp[3] = mp->tmp[0] + 3*mp->nbytes;
+    if (mp->wtmp != mp->wtemp)
+	FREE(mp->wtmp);
+    mp->nlimbs = LIMBS(mp->nbytes);
+    if (mp->nbytes <= 16)
+	mp->wtmp = mp->wtemp;
+    else
+	mp->wtmp = ALLOC((6*mp->nlimbs + 2)*sizeof (XPW_limb));
+    mp->fixed = NULL;
+#ifdef FIXED
+    {
+	int i;
+	for (i = 0; i < (int)(sizeof widths/sizeof widths[0]); i++)
+	    if (n == 64*widths[i].n)
+		mp->fixed = &widths[i];
+    }
+#endif
+}
 
-static int nbytes = (32-1)/8 + 1;
+static void release(void *ctx) {
+    MP_Ctx mp = ctx;
+    if (mp->tmp[0] != mp->temp)
+	FREE(mp->tmp[0]);
+    if (mp->wtmp != mp->wtemp)
+	FREE(mp->wtmp);
+}
 
-static int shift = (32-1)%8;
+static void makekey(void) {
+    pthread_key_create(&key, release);
+}
 
-static unsigned char msb = 0xFF;
+static MP_Ctx current(void) {
+    if (cur == NULL) {
+	MP_Ctx mp = &local;
+	if (mp->nbits == 0) {
+	    resize(mp, 32);
+	    pthread_once(&once, makekey);
+	    pthread_setspecific(key, mp);
+	}
+	cur = mp;
+    }
+    return cur;
+}
 
-static unsigned char temp[16 + 16 + 16 + 2*16+2];
+static int add(MP_Ctx mp, T z, T x, T y) {
+#ifdef FIXED
+    if (mp->fixed)
+	return mp->fixed->add(z, x, y);
+#endif
+    return XP_add(mp->nbytes, z, x, y, 0);
+}
 
-static T tmp[] = {temp, temp+1*16, temp+2*16, temp+3*16};
+static int sub(MP_Ctx mp, T z, T x, T y) {
+#ifdef FIXED
+    if (mp->fixed)
+	return mp->fixed->sub(z, x, y);
+#endif
+    return XP_sub(mp->nbytes, z, x, y, 0);
+}
 
-static int applyu(T op(T, T, T), T z, T x,
+static void mul(MP_Ctx mp, T z, T x, T y) {
+    XPW_T wx = mp->wtmp, wy = wx + mp->nlimbs, wz = wy + mp->nlimbs;
+#ifdef FIXED
+    if (mp->fixed) {
+	mp->fixed->mul(z, x, y);
+	return;
+    }
+#endif
+    XPW_frombytes(mp->nlimbs, wx, mp->nbytes, x);
+    XPW_frombytes(mp->nlimbs, wy, mp->nbytes, y);
+    memset(wz, '\0', 2*mp->nlimbs*sizeof (XPW_limb));
+    XPW_mul(wz, mp->nlimbs, wx, mp->nlimbs, wy);
+    XPW_tobytes(2*mp->nbytes, z, 2*mp->nlimbs, wz);
+}
+
+static int divide(MP_Ctx mp, T q, T x, T y, T r) {
+    XPW_T wx = mp->wtmp, wy = wx + mp->nlimbs, wq = wy + mp->nlimbs,
+	wr = wq + mp->nlimbs;
+    XPW_frombytes(mp->nlimbs, wx, mp->nbytes, x);
+    XPW_frombytes(mp->nlimbs, wy, mp->nbytes, y);
+    if (!XPW_div(mp->nlimbs, wq, wx, mp->nlimbs, wy, wr, wr + mp->nlimbs))
+	return 0;
+    XPW_tobytes(mp->nbytes, q, mp->nlimbs, wq);
+    XPW_tobytes(mp->nbytes, r, mp->nlimbs, wr);
+    return 1;
+}
+
+static int applyu(MP_Ctx mp, T op(T, T, T), T z, T x,
 	unsigned long u) {
     unsigned long carry;
-    { T z = tmp[2]; carry = XP_fromint(nbytes, z, u);
-	carry |= z[nbytes-1]&~msb;
-	z[nbytes-1] &= msb; }
-    op(z, x, tmp[2]);
+    { T z = mp->tmp[2]; carry = XP_fromint(mp->nbytes, z, u);
+	carry |= z[mp->nbytes-1]&~mp->msb;
+	z[mp->nbytes-1] &= mp->msb; }
+    op(z, x, mp->tmp[2]);
     return carry != 0;
 }
 
-static int apply(T op(T, T, T), T z, T x, long v) {
+static int apply(MP_Ctx mp, T op(T, T, T), T z, T x, long v) {
     {
-	T z = tmp[2];
+	T z = mp->tmp[2];
 	if (v == LONG_MIN) {
-	    XP_fromint(nbytes, z, LONG_MAX + 1UL);
-	    XP_neg(nbytes, z, z, 1);
+	    XP_fromint(mp->nbytes, z, LONG_MAX + 1UL);
+	    XP_neg(mp->nbytes, z, z, 1);
 	}
 	else if (v < 0) {
-	    XP_fromint(nbytes, z, -v);
-	    XP_neg(nbytes, z, z, 1);
+	    XP_fromint(mp->nbytes, z, -v);
+	    XP_neg(mp->nbytes, z, z, 1);
 	}
 	else
-	    XP_fromint(nbytes, z, v);
-	z[nbytes-1] &= msb; }
-    op(z, x, tmp[2]);
-    return (nbits < 8*(int)sizeof (v) &&
-	    (v < -(1L<<(nbits-1)) || v >= (1L<<(nbits-1))));
+	    XP_fromint(mp->nbytes, z, v);
+	z[mp->nbytes-1] &= mp->msb; }
+    op(z, x, mp->tmp[2]);
+    return (mp->nbits < 8*(int)sizeof (v) &&
+	    (v < -(1L<<(mp->nbits-1)) || v >= (1L<<(mp->nbits-1))));
 }
 
 int MP_set(int n) {
-    int prev = nbits;
+    MP_Ctx mp = current();
+    int prev = mp->nbits;
     assert(n > 1);
-    nbits  = n;
-    nbytes = (n-1)/8 + 1;
-    shift  = (n-1)%8;
-    msb    = ones(n);
-    if (tmp[0] != temp)
-	FREE(tmp[0]);
-    if (nbytes <= 16)
-	tmp[0] = temp;
-    else
-	tmp[0] = ALLOC(3*nbytes + 2*nbytes + 2);
-    tmp[1] = tmp[0] + 1*nbytes;
-    tmp[2] = tmp[0] + 2*nbytes;
-    tmp[3] = tmp[0] + 3*nbytes;
+    resize(mp, n);
+    return prev;
+}
+
+MP_Ctx MP_newctx(int n) {
+    MP_Ctx mp;
+    assert(n > 1);
+    NEW0(mp);
+    resize(mp, n);
+    return mp;
+}
+
+void MP_freectx(MP_Ctx *ctx) {
+    MP_Ctx mp;
+    assert(ctx && *ctx);
+    mp = *ctx;
+    assert(mp != &local);
+    if (cur == mp)
+	cur = NULL;
+    release(mp);
+    FREE(*ctx);
+}
+
+MP_Ctx MP_usectx(MP_Ctx ctx) {
+    MP_Ctx prev = current();
+    cur = ctx ? ctx : &local;
     return prev;
 }
 
 T MP_new(unsigned long u) {
-    return MP_fromintu(ALLOC(nbytes), u);
+    MP_Ctx mp = current();
+    return MP_fromintu(ALLOC(mp->nbytes), u);
 }
 
 T MP_fromintu(T z, unsigned long u) {
+    MP_Ctx mp = current();
     unsigned long carry;
     assert(z);
-    carry = XP_fromint(nbytes, z, u);
-    carry |= z[nbytes-1]&~msb;
-    z[nbytes-1] &= msb;
+    carry = XP_fromint(mp->nbytes, z, u);
+    carry |= z[mp->nbytes-1]&~mp->msb;
+    z[mp->nbytes-1] &= mp->msb;
     if (carry)
 	RAISE(MP_Overflow);
     return z;
 }
 
 T MP_fromint(T z, long v) {
+    MP_Ctx mp = current();
     assert(z);
     if (v == LONG_MIN) {
-	XP_fromint(nbytes, z, LONG_MAX + 1UL);
-	XP_neg(nbytes, z, z, 1);
+	XP_fromint(mp->nbytes, z, LONG_MAX + 1UL);
+	XP_neg(mp->nbytes, z, z, 1);
     }
     else if (v < 0) {
-	XP_fromint(nbytes, z, -v);
-	XP_neg(nbytes, z, z, 1);
+	XP_fromint(mp->nbytes, z, -v);
+	XP_neg(mp->nbytes, z, z, 1);
     }
     else
-	XP_fromint(nbytes, z, v);
-    z[nbytes-1] &= msb;
-    if ((nbits < 8*(int)sizeof (v) &&
-		(v < -(1L<<(nbits-1)) || v >= (1L<<(nbits-1)))))
+	XP_fromint(mp->nbytes, z, v);
+    z[mp->nbytes-1] &= mp->msb;
+    if ((mp->nbits < 8*(int)sizeof (v) &&
+		(v < -(1L<<(mp->nbits-1)) || v >= (1L<<(mp->nbits-1)))))
 	RAISE(MP_Overflow);
     return z;
 }
@@ -141,13 +329,14 @@ long MP_toint(T x) {
 }
 
 T MP_cvt(int m, T z, T x) {
+    MP_Ctx mp = current();
     int fill, i, mbytes = (m - 1)/8 + 1;
     assert(m > 1);
     assert(x); assert(z);
-    fill = sign(x) ? 0xFF : 0;
-    if (m < nbits) {
+    fill = sign(mp, x) ? 0xFF : 0;
+    if (m < mp->nbits) {
 	int carry = (x[mbytes-1]^fill)&~ones(m);
-	for (i = mbytes; i < nbytes; i++)
+	for (i = mbytes; i < mp->nbytes; i++)
 	    carry |= x[i]^fill;
 	memcpy(z, x, mbytes);
 	z[mbytes-1] &= ones(m);
@@ -155,9 +344,9 @@ T MP_cvt(int m, T z, T x) {
 	    RAISE(MP_Overflow);
     }
     else {
-	memcpy(z, x, nbytes);
-	z[nbytes-1] |= fill&~msb;
-	for (i = nbytes; i < mbytes; i++)
+	memcpy(z, x, mp->nbytes);
+	z[mp->nbytes-1] |= fill&~mp->msb;
+	for (i = mp->nbytes; i < mbytes; i++)
 	    z[i] = fill;
 	z[mbytes-1] &= ones(m);
     }
@@ -172,462 +361,485 @@ unsigned long MP_tointu(T x) {
 }
 
 T MP_cvtu(int m, T z, T x) {
+    MP_Ctx mp = current();
     int i, mbytes = (m - 1)/8 + 1;
     assert(m > 1);
     assert(x); assert(z);
-    if (m < nbits) {
+    if (m < mp->nbits) {
 	int carry = x[mbytes-1]&~ones(m);
-	for (i = mbytes; i < nbytes; i++)
+	for (i = mbytes; i < mp->nbytes; i++)
 	    carry |= x[i];
 	memcpy(z, x, mbytes);
 	z[mbytes-1] &= ones(m);
 	if (carry)
 	    RAISE(MP_Overflow);
     } else {
-	memcpy(z, x, nbytes);
-	for (i = nbytes; i < mbytes; i++)
+	memcpy(z, x, mp->nbytes);
+	for (i = mp->nbytes; i < mbytes; i++)
 	    z[i] = 0;
     }
     return z;
 }
 
 T MP_addu(T z, T x, T y) {
+    MP_Ctx mp = current();
     int carry;
     assert(x); assert(y); assert(z);
-    carry = XP_add(nbytes, z, x, y, 0);
-    carry |= z[nbytes-1]&~msb;
-    z[nbytes-1] &= msb;
+    carry = add(mp, z, x, y);
+    carry |= z[mp->nbytes-1]&~mp->msb;
+    z[mp->nbytes-1] &= mp->msb;
     if (carry)
 	RAISE(MP_Overflow);
     return z;
 }
 
 T MP_subu(T z, T x, T y) {
+    MP_Ctx mp = current();
     int borrow;
     assert(x); assert(y); assert(z);
-    borrow = XP_sub(nbytes, z, x, y, 0);
-    borrow |= z[nbytes-1]&~msb;
-    z[nbytes-1] &= msb;
+    borrow = sub(mp, z, x, y);
+    borrow |= z[mp->nbytes-1]&~mp->msb;
+    z[mp->nbytes-1] &= mp->msb;
     if (borrow)
 	RAISE(MP_Overflow);
     return z;
 }
 
 T MP_mul2u(T z, T x, T y) {
+    MP_Ctx mp = current();
     assert(x); assert(y); assert(z);
-    memset(tmp[3], '\0', 2*nbytes);
-    XP_mul(tmp[3], nbytes, x, nbytes, y);
-    memcpy(z, tmp[3], (2*nbits - 1)/8 + 1);
+    mul(mp, mp->tmp[3], x, y);
+    memcpy(z, mp->tmp[3], (2*mp->nbits - 1)/8 + 1);
     return z;
 }
 
 T MP_mulu(T z, T x, T y) {
+    MP_Ctx mp = current();
     assert(x); assert(y); assert(z);
-    memset(tmp[3], '\0', 2*nbytes);
-    XP_mul(tmp[3], nbytes, x, nbytes, y);
-    memcpy(z, tmp[3], nbytes);
-    z[nbytes-1] &= msb;
+    mul(mp, mp->tmp[3], x, y);
+    memcpy(z, mp->tmp[3], mp->nbytes);
+    z[mp->nbytes-1] &= mp->msb;
     {
 	int i;
-	if (tmp[3][nbytes-1]&~msb)
+	if (mp->tmp[3][mp->nbytes-1]&~mp->msb)
 	    RAISE(MP_Overflow);
-	for (i = 0; i < nbytes; i++)
-	    if (tmp[3][i+nbytes] != 0)
+	for (i = 0; i < mp->nbytes; i++)
+	    if (mp->tmp[3][i+mp->nbytes] != 0)
 		RAISE(MP_Overflow);
     }
     return z;
 }
 
 T MP_divu(T z, T x, T y) {
+    MP_Ctx mp = current();
     assert(x); assert(y); assert(z);
     {
-	memcpy(tmp[1], y, nbytes);
-	y = tmp[1];
+	memcpy(mp->tmp[1], y, mp->nbytes);
+	y = mp->tmp[1];
     }
-    if (!XP_div(nbytes, z, x, nbytes, y, tmp[2], tmp[3]))
+    if (!divide(mp, z, x, y, mp->tmp[2]))
 	RAISE(MP_Dividebyzero);
     return z;
 }
 
 T MP_modu(T z, T x, T y) {
+    MP_Ctx mp = current();
     assert(x); assert(y); assert(z);
     {
-	memcpy(tmp[1], y, nbytes);
-	y = tmp[1];
+	memcpy(mp->tmp[1], y, mp->nbytes);
+	y = mp->tmp[1];
     }
-    if (!XP_div(nbytes, tmp[2], x, nbytes, y, z, tmp[3]))
+    if (!divide(mp, mp->tmp[2], x, y, z))
 	RAISE(MP_Dividebyzero);
     return z;
 }
 
 T MP_add(T z, T x, T y) {
+    MP_Ctx mp = current();
     int sx, sy;
     assert(x); assert(y); assert(z);
-    sx = sign(x);
-    sy = sign(y);
-    XP_add(nbytes, z, x, y, 0);
-    z[nbytes-1] &= msb;
-    if (sx == sy && sy != sign(z))
+    sx = sign(mp, x);
+    sy = sign(mp, y);
+    add(mp, z, x, y);
+    z[mp->nbytes-1] &= mp->msb;
+    if (sx == sy && sy != sign(mp, z))
 	RAISE(MP_Overflow);
     return z;
 }
 
 T MP_sub(T z, T x, T y) {
+    MP_Ctx mp = current();
     int sx, sy;
     assert(x); assert(y); assert(z);
-    sx = sign(x);
-    sy = sign(y);
-    XP_sub(nbytes, z, x, y, 0);
-    z[nbytes-1] &= msb;
-    if (sx != sy && sy == sign(z))
+    sx = sign(mp, x);
+    sy = sign(mp, y);
+    sub(mp, z, x, y);
+    z[mp->nbytes-1] &= mp->msb;
+    if (sx != sy && sy == sign(mp, z))
 	RAISE(MP_Overflow);
     return z;
 }
 
 T MP_neg(T z, T x) {
+    MP_Ctx mp = current();
     int sx;
     assert(x); assert(z);
-    sx = sign(x);
-    XP_neg(nbytes, z, x, 1);
-    z[nbytes-1] &= msb;
-    if (sx && sx == sign(z))
+    sx = sign(mp, x);
+    XP_neg(mp->nbytes, z, x, 1);
+    z[mp->nbytes-1] &= mp->msb;
+    if (sx && sx == sign(mp, z))
 	RAISE(MP_Overflow);
     return z;
 }
 
 T MP_mul2(T z, T x, T y) {
+    MP_Ctx mp = current();
     int sx, sy;
     assert(x); assert(y); assert(z);
-    sx = sign(x);
-    sy = sign(y);
+    sx = sign(mp, x);
+    sy = sign(mp, y);
     if (sx) {
-	XP_neg(nbytes, tmp[0], x, 1);
-	x = tmp[0];
-	x[nbytes-1] &= msb;
+	XP_neg(mp->nbytes, mp->tmp[0], x, 1);
+	x = mp->tmp[0];
+	x[mp->nbytes-1] &= mp->msb;
     }
     if (sy) {
-	XP_neg(nbytes, tmp[1], y, 1);
-	y = tmp[1];
-	y[nbytes-1] &= msb;
+	XP_neg(mp->nbytes, mp->tmp[1], y, 1);
+	y = mp->tmp[1];
+	y[mp->nbytes-1] &= mp->msb;
     }
-    memset(tmp[3], '\0', 2*nbytes);
-    XP_mul(tmp[3], nbytes, x, nbytes, y);
+    mul(mp, mp->tmp[3], x, y);
     if (sx != sy)
-	XP_neg((2*nbits - 1)/8 + 1, z, tmp[3], 1);
+	XP_neg((2*mp->nbits - 1)/8 + 1, z, mp->tmp[3], 1);
     else
-	memcpy(z, tmp[3], (2*nbits - 1)/8 + 1);
+	memcpy(z, mp->tmp[3], (2*mp->nbits - 1)/8 + 1);
     return z;
 }
 
 T MP_mul(T z, T x, T y) {
+    MP_Ctx mp = current();
     int sx, sy;
     assert(x); assert(y); assert(z);
-    sx = sign(x);
-    sy = sign(y);
+    sx = sign(mp, x);
+    sy = sign(mp, y);
     if (sx) {
-	XP_neg(nbytes, tmp[0], x, 1);
-	x = tmp[0];
-	x[nbytes-1] &= msb;
+	XP_neg(mp->nbytes, mp->tmp[0], x, 1);
+	x = mp->tmp[0];
+	x[mp->nbytes-1] &= mp->msb;
     }
     if (sy) {
-	XP_neg(nbytes, tmp[1], y, 1);
-	y = tmp[1];
-	y[nbytes-1] &= msb;
+	XP_neg(mp->nbytes, mp->tmp[1], y, 1);
+	y = mp->tmp[1];
+	y[mp->nbytes-1] &= mp->msb;
     }
-    memset(tmp[3], '\0', 2*nbytes);
-    XP_mul(tmp[3], nbytes, x, nbytes, y);
+    mul(mp, mp->tmp[3], x, y);
     if (sx != sy)
-	XP_neg(nbytes, z, tmp[3], 1);
+	XP_neg(mp->nbytes, z, mp->tmp[3], 1);
     else
-	memcpy(z, tmp[3], nbytes);
-    z[nbytes-1] &= msb;
+	memcpy(z, mp->tmp[3], mp->nbytes);
+    z[mp->nbytes-1] &= mp->msb;
     {
 	int i;
-	if (tmp[3][nbytes-1]&~msb)
+	if (mp->tmp[3][mp->nbytes-1]&~mp->msb)
 	    RAISE(MP_Overflow);
-	for (i = 0; i < nbytes; i++)
-	    if (tmp[3][i+nbytes] != 0)
+	for (i = 0; i < mp->nbytes; i++)
+	    if (mp->tmp[3][i+mp->nbytes] != 0)
 		RAISE(MP_Overflow);
     }
-    if (sx == sy && sign(z))
+    if (sx == sy && sign(mp, z))
 	RAISE(MP_Overflow);
     return z;
 }
 
 T MP_div(T z, T x, T y) {
+    MP_Ctx mp = current();
     int sx, sy;
     assert(x); assert(y); assert(z);
-    sx = sign(x);
-    sy = sign(y);
+    sx = sign(mp, x);
+    sy = sign(mp, y);
     if (sx) {
-	XP_neg(nbytes, tmp[0], x, 1);
-	x = tmp[0];
-	x[nbytes-1] &= msb;
+	XP_neg(mp->nbytes, mp->tmp[0], x, 1);
+	x = mp->tmp[0];
+	x[mp->nbytes-1] &= mp->msb;
     }
     if (sy) {
-	XP_neg(nbytes, tmp[1], y, 1);
-	y = tmp[1];
-	y[nbytes-1] &= msb;
+	XP_neg(mp->nbytes, mp->tmp[1], y, 1);
+	y = mp->tmp[1];
+	y[mp->nbytes-1] &= mp->msb;
     } else {
-	memcpy(tmp[1], y, nbytes);
-	y = tmp[1];
+	memcpy(mp->tmp[1], y, mp->nbytes);
+	y = mp->tmp[1];
     }
-    if (!XP_div(nbytes, z, x, nbytes, y, tmp[2], tmp[3]))
+    if (!divide(mp, z, x, y, mp->tmp[2]))
 	RAISE(MP_Dividebyzero);
     if (sx != sy) {
-	XP_neg(nbytes, z, z, 1);
-	if (!iszero(tmp[2]))
-	    XP_diff(nbytes, z, z, 1);
-	z[nbytes-1] &= msb;
-    } else if (sx && sign(z))
+	XP_neg(mp->nbytes, z, z, 1);
+	if (!iszero(mp, mp->tmp[2]))
+	    XP_diff(mp->nbytes, z, z, 1);
+	z[mp->nbytes-1] &= mp->msb;
+    } else if (sx && sign(mp, z))
 	RAISE(MP_Overflow);
     return z;
 }
 
 T MP_mod(T z, T x, T y) {
+    MP_Ctx mp = current();
     int sx, sy;
     assert(x); assert(y); assert(z);
-    sx = sign(x);
-    sy = sign(y);
+    sx = sign(mp, x);
+    sy = sign(mp, y);
     if (sx) {
-	XP_neg(nbytes, tmp[0], x, 1);
-	x = tmp[0];
-	x[nbytes-1] &= msb;
+	XP_neg(mp->nbytes, mp->tmp[0], x, 1);
+	x = mp->tmp[0];
+	x[mp->nbytes-1] &= mp->msb;
     }
     if (sy) {
-	XP_neg(nbytes, tmp[1], y, 1);
-	y = tmp[1];
-	y[nbytes-1] &= msb;
+	XP_neg(mp->nbytes, mp->tmp[1], y, 1);
+	y = mp->tmp[1];
+	y[mp->nbytes-1] &= mp->msb;
     } else {
-	memcpy(tmp[1], y, nbytes);
-	y = tmp[1];
+	memcpy(mp->tmp[1], y, mp->nbytes);
+	y = mp->tmp[1];
     }
-    if (!XP_div(nbytes, tmp[2], x, nbytes, y, z, tmp[3]))
+    if (!divide(mp, mp->tmp[2], x, y, z))
 	RAISE(MP_Dividebyzero);
     if (sx != sy) {
-	if (!iszero(z))
-	    XP_sub(nbytes, z, y, z, 0);
-    } else if (sx && sign(tmp[2]))
+	if (!iszero(mp, z))
+	    XP_sub(mp->nbytes, z, y, z, 0);
+    } else if (sx && sign(mp, mp->tmp[2]))
 	RAISE(MP_Overflow);
     return z;
 }
 
 T MP_addui(T z, T x, unsigned long y) {
+    MP_Ctx mp = current();
     assert(x); assert(z);
     if (y < BASE) {
-	int carry = XP_sum(nbytes, z, x, y);
-	carry |= z[nbytes-1]&~msb;
-	z[nbytes-1] &= msb;
+	int carry = XP_sum(mp->nbytes, z, x, y);
+	carry |= z[mp->nbytes-1]&~mp->msb;
+	z[mp->nbytes-1] &= mp->msb;
 	if (carry)
 	    RAISE(MP_Overflow);
-    } else if (applyu(MP_addu, z, x, y))
+    } else if (applyu(mp, MP_addu, z, x, y))
 	RAISE(MP_Overflow);
     return z;
 }
 
 T MP_subui(T z, T x, unsigned long y) {
+    MP_Ctx mp = current();
     assert(x); assert(z);
     if (y < BASE) {
-	int borrow = XP_diff(nbytes, z, x, y);
-	borrow |= z[nbytes-1]&~msb;
-	z[nbytes-1] &= msb;
+	int borrow = XP_diff(mp->nbytes, z, x, y);
+	borrow |= z[mp->nbytes-1]&~mp->msb;
+	z[mp->nbytes-1] &= mp->msb;
 	if (borrow)
 	    RAISE(MP_Overflow);
-    } else if (applyu(MP_subu, z, x, y))
+    } else if (applyu(mp, MP_subu, z, x, y))
 	RAISE(MP_Overflow);
     return z;
 }
 
 T MP_mului(T z, T x, unsigned long y) {
+    MP_Ctx mp = current();
     assert(x); assert(z);
     if (y < BASE) {
-	int carry = XP_product(nbytes, z, x, y);
-	carry |= z[nbytes-1]&~msb;
-	z[nbytes-1] &= msb;
+	int carry = XP_product(mp->nbytes, z, x, y);
+	carry |= z[mp->nbytes-1]&~mp->msb;
+	z[mp->nbytes-1] &= mp->msb;
 	if (carry)
 	    RAISE(MP_Overflow);
-	if (nbits < 8 && y >= (1U<<nbits))
+	if (mp->nbits < 8 && y >= (1U<<mp->nbits))
 	    RAISE(MP_Overflow);
-    } else if (applyu(MP_mulu, z, x, y))
+    } else if (applyu(mp, MP_mulu, z, x, y))
 	RAISE(MP_Overflow);
     return z;
 }
 
 T MP_divui(T z, T x, unsigned long y) {
+    MP_Ctx mp = current();
     assert(x); assert(z);
     if (y == 0)
 	RAISE(MP_Dividebyzero);
     else if (y < BASE) {
-	XP_quotient(nbytes, z, x, y);
-	if (nbits < 8 && y >= (1U<<nbits))
+	XP_quotient(mp->nbytes, z, x, y);
+	if (mp->nbits < 8 && y >= (1U<<mp->nbits))
 	    RAISE(MP_Overflow);
-    } else if (applyu(MP_divu, z, x, y))
+    } else if (applyu(mp, MP_divu, z, x, y))
 	RAISE(MP_Overflow);
     return z;
 }
 
 unsigned long MP_modui(T x, unsigned long y) {
+    MP_Ctx mp = current();
     assert(x);
     if (y == 0)
 	RAISE(MP_Dividebyzero);
     else if (y < BASE) {
-	int r = XP_quotient(nbytes, tmp[2], x, y);
-	if (nbits < 8 && y >= (1U<<nbits))
+	int r = XP_quotient(mp->nbytes, mp->tmp[2], x, y);
+	if (mp->nbits < 8 && y >= (1U<<mp->nbits))
 	    RAISE(MP_Overflow);
 	return r;
     }
-    else if (applyu(MP_modu, tmp[2], x, y))
+    else if (applyu(mp, MP_modu, mp->tmp[2], x, y))
 	RAISE(MP_Overflow);
-    return XP_toint(nbytes, tmp[2]);
+    return XP_toint(mp->nbytes, mp->tmp[2]);
 }
 
 T MP_addi(T z, T x, long y) {
+    MP_Ctx mp = current();
     assert(x); assert(z);
     if (-BASE < y && y < BASE) {
-	int sx = sign(x), sy = y < 0;
+	int sx = sign(mp, x), sy = y < 0;
 	if (sy)
-	    XP_diff(nbytes, z, x, -y);
+	    XP_diff(mp->nbytes, z, x, -y);
 	else
-	    XP_sum (nbytes, z, x,  y);
-	z[nbytes-1] &= msb;
-	if (sx == sy && sy != sign(z))
+	    XP_sum (mp->nbytes, z, x,  y);
+	z[mp->nbytes-1] &= mp->msb;
+	if (sx == sy && sy != sign(mp, z))
 	    RAISE(MP_Overflow);
-	if (nbits < 8
-		&& (y < -(1<<(nbits-1)) || y >= (1<<(nbits-1))))
+	if (mp->nbits < 8
+		&& (y < -(1<<(mp->nbits-1)) || y >= (1<<(mp->nbits-1))))
 	    RAISE(MP_Overflow);
-    } else if (apply(MP_add, z, x, y))
+    } else if (apply(mp, MP_add, z, x, y))
 	RAISE(MP_Overflow);
     return z;
 }
 
 T MP_subi(T z, T x, long y) {
+    MP_Ctx mp = current();
     assert(x); assert(z);
     if (-BASE < y && y < BASE) {
-	int sx = sign(x), sy = y < 0;
+	int sx = sign(mp, x), sy = y < 0;
 	if (sy)
-	    XP_sum (nbytes, z, x, -y);
+	    XP_sum (mp->nbytes, z, x, -y);
 	else
-	    XP_diff(nbytes, z, x,  y);
-	z[nbytes-1] &= msb;
-	if (sx != sy && sy == sign(z))
+	    XP_diff(mp->nbytes, z, x,  y);
+	z[mp->nbytes-1] &= mp->msb;
+	if (sx != sy && sy == sign(mp, z))
 	    RAISE(MP_Overflow);
-	if (nbits < 8
-		&& (y < -(1<<(nbits-1)) || y >= (1<<(nbits-1))))
+	if (mp->nbits < 8
+		&& (y < -(1<<(mp->nbits-1)) || y >= (1<<(mp->nbits-1))))
 	    RAISE(MP_Overflow);
-    } else if (apply(MP_sub, z, x, y))
+    } else if (apply(mp, MP_sub, z, x, y))
 	RAISE(MP_Overflow);
     return z;
 }
 
 T MP_muli(T z, T x, long y) {
+    MP_Ctx mp = current();
     assert(x); assert(z);
     if (-BASE < y && y < BASE) {
-	int sx = sign(x), sy = y < 0;
+	int sx = sign(mp, x), sy = y < 0;
 	if (sx) {
-	    XP_neg(nbytes, tmp[0], x, 1);
-	    x = tmp[0];
-	    x[nbytes-1] &= msb;
+	    XP_neg(mp->nbytes, mp->tmp[0], x, 1);
+	    x = mp->tmp[0];
+	    x[mp->nbytes-1] &= mp->msb;
 	}
-	XP_product(nbytes, z, x, sy ? -y : y);
+	XP_product(mp->nbytes, z, x, sy ? -y : y);
 	if (sx != sy)
-	    XP_neg(nbytes, z, x, 1);
-	z[nbytes-1] &= msb;
-	if (sx == sy && sign(z))
+	    XP_neg(mp->nbytes, z, x, 1);
+	z[mp->nbytes-1] &= mp->msb;
+	if (sx == sy && sign(mp, z))
 	    RAISE(MP_Overflow);
-	if (nbits < 8
-		&& (y < -(1<<(nbits-1)) || y >= (1<<(nbits-1))))
+	if (mp->nbits < 8
+		&& (y < -(1<<(mp->nbits-1)) || y >= (1<<(mp->nbits-1))))
 	    RAISE(MP_Overflow);
-    } else if (apply(MP_mul, z, x, y))
+    } else if (apply(mp, MP_mul, z, x, y))
 	RAISE(MP_Overflow);
     return z;
 }
 
 T MP_divi(T z, T x, long y) {
+    MP_Ctx mp = current();
     assert(x); assert(z);
     if (y == 0)
 	RAISE(MP_Dividebyzero);
     else if (-BASE < y && y < BASE) {
 	int r;
-	int sx = sign(x), sy = y < 0;
+	int sx = sign(mp, x), sy = y < 0;
 	if (sx) {
-	    XP_neg(nbytes, tmp[0], x, 1);
-	    x = tmp[0];
-	    x[nbytes-1] &= msb;
+	    XP_neg(mp->nbytes, mp->tmp[0], x, 1);
+	    x = mp->tmp[0];
+	    x[mp->nbytes-1] &= mp->msb;
 	}
-	r = XP_quotient(nbytes, z, x, sy ? -y : y);
+	r = XP_quotient(mp->nbytes, z, x, sy ? -y : y);
 	if (sx != sy) {
-	    XP_neg(nbytes, z, z, 1);
+	    XP_neg(mp->nbytes, z, z, 1);
 	    if (r != 0) {
-		XP_diff(nbytes, z, z, 1);
+		XP_diff(mp->nbytes, z, z, 1);
 		r = y - r;
 	    }
-	    z[nbytes-1] &= msb;
-	} else if (sx && sign(z))
+	    z[mp->nbytes-1] &= mp->msb;
+	} else if (sx && sign(mp, z))
 	    RAISE(MP_Overflow);
-	if (nbits < 8
-		&& (y < -(1<<(nbits-1)) || y >= (1<<(nbits-1))))
+	if (mp->nbits < 8
+		&& (y < -(1<<(mp->nbits-1)) || y >= (1<<(mp->nbits-1))))
 	    RAISE(MP_Overflow);
-    } else if (apply(MP_div, z, x, y))
+    } else if (apply(mp, MP_div, z, x, y))
 	RAISE(MP_Overflow);
     return z;
 }
 
 long MP_modi(T x, long y) {
+    MP_Ctx mp = current();
     assert(x);
     if (y == 0)
 	RAISE(MP_Dividebyzero);
     else if (-BASE < y && y < BASE) {
-	T z = tmp[2];
+	T z = mp->tmp[2];
 	int r;
-	int sx = sign(x), sy = y < 0;
+	int sx = sign(mp, x), sy = y < 0;
 	if (sx) {
-	    XP_neg(nbytes, tmp[0], x, 1);
-	    x = tmp[0];
-	    x[nbytes-1] &= msb;
+	    XP_neg(mp->nbytes, mp->tmp[0], x, 1);
+	    x = mp->tmp[0];
+	    x[mp->nbytes-1] &= mp->msb;
 	}
-	r = XP_quotient(nbytes, z, x, sy ? -y : y);
+	r = XP_quotient(mp->nbytes, z, x, sy ? -y : y);
 	if (sx != sy) {
-	    XP_neg(nbytes, z, z, 1);
+	    XP_neg(mp->nbytes, z, z, 1);
 	    if (r != 0) {
-		XP_diff(nbytes, z, z, 1);
+		XP_diff(mp->nbytes, z, z, 1);
 		r = y - r;
 	    }
-	    z[nbytes-1] &= msb;
+	    z[mp->nbytes-1] &= mp->msb;
 	}
-	else if (sx && sign(z))
+	else if (sx && sign(mp, z))
 	    RAISE(MP_Overflow);
-	if (nbits < 8
-		&& (y < -(1<<(nbits-1)) || y >= (1<<(nbits-1))))
+	if (mp->nbits < 8
+		&& (y < -(1<<(mp->nbits-1)) || y >= (1<<(mp->nbits-1))))
 	    RAISE(MP_Overflow);
 	return r;
     }
-    else if (apply(MP_mod, tmp[2], x, y))
+    else if (apply(mp, MP_mod, mp->tmp[2], x, y))
 	RAISE(MP_Overflow);
-    return MP_toint(tmp[2]);
+    return MP_toint(mp->tmp[2]);
 }
 
 int MP_cmpu(T x, T y) {
+    MP_Ctx mp = current();
     assert(x);
     assert(y);
-    return XP_cmp(nbytes, x, y);
+    return XP_cmp(mp->nbytes, x, y);
 }
 
 int MP_cmp(T x, T y) {
+    MP_Ctx mp = current();
     int sx, sy;
     assert(x);
     assert(y);
-    sx = sign(x);
-    sy = sign(y);
+    sx = sign(mp, x);
+    sy = sign(mp, y);
     if (sx != sy)
 	return sy - sx;
     else
-	return XP_cmp(nbytes, x, y);
+	return XP_cmp(mp->nbytes, x, y);
 }
 
 int MP_cmpui(T x, unsigned long y) {
+    MP_Ctx mp = current();
     assert(x);
-    if ((int)sizeof y >= nbytes) {
-	unsigned long v = XP_toint(nbytes, x);
+    if ((int)sizeof y >= mp->nbytes) {
+	unsigned long v = XP_toint(mp->nbytes, x);
 	if (v < y)
 	    return -1;
 	else if (v > y)
@@ -635,18 +847,19 @@ int MP_cmpui(T x, unsigned long y) {
 	else
 	    return 0;
     } else {
-	XP_fromint(nbytes, tmp[2], y);
-	return XP_cmp(nbytes, x, tmp[2]);
+	XP_fromint(mp->nbytes, mp->tmp[2], y);
+	return XP_cmp(mp->nbytes, x, mp->tmp[2]);
     }
 }
 
 int MP_cmpi(T x, long y) {
+    MP_Ctx mp = current();
     int sx, sy = y < 0;
     assert(x);
-    sx = sign(x);
+    sx = sign(mp, x);
     if (sx != sy)
 	return sy - sx;
-    else if ((int)sizeof y >= nbytes) {
+    else if ((int)sizeof y >= mp->nbytes) {
 	long v = MP_toint(x);
 	if (v < y)
 	    return -1;
@@ -656,8 +869,8 @@ int MP_cmpi(T x, long y) {
 	    return 0;
     }
     else {
-	MP_fromint(tmp[2], y);
-	return XP_cmp(nbytes, x, tmp[2]);
+	MP_fromint(mp->tmp[2], y);
+	return XP_cmp(mp->nbytes, x, mp->tmp[2]);
     }
 }
 
@@ -668,11 +881,12 @@ T MP_or (T z, T x, T y) { bitop(|); }
 T MP_xor(T z, T x, T y) { bitop(^); }
 
 T MP_not(T z, T x) {
+    MP_Ctx mp = current();
     int i;
     assert(x); assert(z);
-    for (i = 0; i < nbytes; i++)
+    for (i = 0; i < mp->nbytes; i++)
 	z[i] = ~x[i];
-    z[nbytes-1] &= msb;
+    z[mp->nbytes-1] &= mp->msb;
     return z;
 }
 
@@ -686,21 +900,23 @@ T MP_lshift(T z, T x, int s) { shft(0, XP_lshift); }
 
 T MP_rshift(T z, T x, int s) { shft(0, XP_rshift); }
 
-T MP_ashift(T z, T x, int s) { shft(sign(x),XP_rshift); }
+T MP_ashift(T z, T x, int s) { shft(sign(mp, x),XP_rshift); }
 
 T MP_fromstr(T z, const char *str, int base, char **end){
+    MP_Ctx mp = current();
     int carry;
     assert(z);
-    memset(z, '\0', nbytes);
-    carry = XP_fromstr(nbytes, z, str, base, end);
-    carry |= z[nbytes-1]&~msb;
-    z[nbytes-1] &= msb;
+    memset(z, '\0', mp->nbytes);
+    carry = XP_fromstr(mp->nbytes, z, str, base, end);
+    carry |= z[mp->nbytes-1]&~mp->msb;
+    z[mp->nbytes-1] &= mp->msb;
     if (carry)
 	RAISE(MP_Overflow);
     return z;
 }
 
 char *MP_tostr(char *str, int size, int base, T x) {
+    MP_Ctx mp = current();
     assert(x);
     assert(base >= 2 && base <= 36);
     assert(str == NULL || size > 1);
@@ -709,12 +925,12 @@ char *MP_tostr(char *str, int size, int base, T x) {
 	    int k;
 	    for (k = 5; (1<<k) > base; k--)
 		;
-	    size = nbits/k + 1 + 1;
+	    size = mp->nbits/k + 1 + 1;
 	}
 	str = ALLOC(size);
     }
-    memcpy(tmp[1], x, nbytes);
-    XP_tostr(str, size, base, nbytes, tmp[1]);
+    XPW_frombytes(mp->nlimbs, mp->wtmp, mp->nbytes, x);
+    XPW_tostr(str, size, base, mp->nlimbs, mp->wtmp);
     return str;
 }
 
@@ -735,6 +951,7 @@ void MP_fmtu(int code, va_list_box *box,
 void MP_fmt(int code, va_list_box *box,
 	int put(int c, void *cl), void *cl,
 	unsigned char flags[], int width, int precision) {
+    MP_Ctx mp = current();
     T x;
     int base, size, sx;
     char *buf;
@@ -743,17 +960,17 @@ void MP_fmt(int code, va_list_box *box,
     assert(x);
     base = va_arg(box->ap, int);
     assert(base >= 2 && base <= 36);
-    sx = sign(x);
+    sx = sign(mp, x);
     if (sx) {
-	XP_neg(nbytes, tmp[0], x, 1);
-	x = tmp[0];
-	x[nbytes-1] &= msb;
+	XP_neg(mp->nbytes, mp->tmp[0], x, 1);
+	x = mp->tmp[0];
+	x[mp->nbytes-1] &= mp->msb;
     }
     {
 	int k;
 	for (k = 5; (1<<k) > base; k--)
 	    ;
-	size = nbits/k + 1 + 1;
+	size = mp->nbits/k + 1 + 1;
     }
     buf = ALLOC(size+1);
     if (sx) {
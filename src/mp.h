@@ -10,12 +10,20 @@
 
 typedef unsigned char *T;
 
+typedef struct MP_Ctx *MP_Ctx;
+
 extern const Except_T MP_Overflow;
 
 extern const Except_T MP_Dividebyzero;
 
 extern int MP_set(int n);
 
+extern MP_Ctx MP_newctx(int n);
+
+extern void MP_freectx(MP_Ctx *ctx);
+
+extern MP_Ctx MP_usectx(MP_Ctx ctx);
+
 extern T MP_new(unsigned long u);
 
 extern T MP_fromint(T z, long v);
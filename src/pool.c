@@ -0,0 +1,242 @@
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "assert.h"
+#include "mem.h"
+#include "thread.h"
+#include "sem.h"
+#include "pool.h"
+
+#define T Pool_T
+
+struct frame {
+    atomic_int pending;
+};
+
+struct task {
+    int (*apply)(void *);
+    void *args;
+    struct frame *parent;
+    struct frame frame;
+};
+
+struct worker {
+    T pool;
+    Thread_T thread;
+    Sem_T lock;
+    struct frame *current;
+    struct task **tasks;
+    long size, top, bottom;
+};
+
+struct T {
+    int nworkers;
+    struct worker *workers;
+    struct frame root;
+    Thread_T owner;
+    atomic_int queued;
+    atomic_int sleepers;
+    atomic_int syncers;
+    atomic_int stop;
+    pthread_mutex_t idle;
+    pthread_cond_t wake;
+};
+
+static _Thread_local struct worker *self;
+
+static _Thread_local unsigned seed;
+
+static void push(struct worker *w, struct task *t) {
+    LOCK(w->lock)
+	if (w->bottom - w->top == w->size) {
+	    long i, size = 2*w->size;
+	    struct task **tasks = ALLOC(size*sizeof (tasks[0]));
+	    for (i = w->top; i < w->bottom; i++)
+		tasks[i%size] = w->tasks[i%w->size];
+	    FREE(w->tasks);
+	    w->tasks = tasks;
+	    w->size = size;
+	}
+	w->tasks[w->bottom++%w->size] = t;
+    END_LOCK;
+}
+
+static struct task *pop(struct worker *w) {
+    struct task *t = NULL;
+    LOCK(w->lock)
+	if (w->bottom > w->top)
+	    t = w->tasks[--w->bottom%w->size];
+	if (w->bottom == w->top)
+	    w->bottom = w->top = 0;
+    END_LOCK;
+    return t;
+}
+
+static struct task *steal(struct worker *w) {
+    struct task *t = NULL;
+    LOCK(w->lock)
+	if (w->bottom > w->top)
+	    t = w->tasks[w->top++%w->size];
+	if (w->bottom == w->top)
+	    w->bottom = w->top = 0;
+    END_LOCK;
+    return t;
+}
+
+static struct worker *me(T pool) {
+    if (self && self->pool == pool)
+	return self;
+    assert(pool->owner == Thread_self());
+    return &pool->workers[0];
+}
+
+static struct task *next(T pool, struct worker *w) {
+    struct task *t;
+    int i, k;
+    if ((t = pop(w)) == NULL) {
+	seed = seed*1103515245 + 12345;
+	k = (seed>>16)%pool->nworkers;
+	for (i = 0; i < pool->nworkers && t == NULL; i++)
+	    if (&pool->workers[(k + i)%pool->nworkers] != w)
+		t = steal(&pool->workers[(k + i)%pool->nworkers]);
+    }
+    if (t)
+	atomic_fetch_sub(&pool->queued, 1);
+    return t;
+}
+
+static void wakeup(T pool, int all) {
+    pthread_mutex_lock(&pool->idle);
+    if (all)
+	pthread_cond_broadcast(&pool->wake);
+    else
+	pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->idle);
+}
+
+static void park(T pool, struct frame *f) {
+    pthread_mutex_lock(&pool->idle);
+    atomic_fetch_add(&pool->sleepers, 1);
+    if (f)
+	atomic_fetch_add(&pool->syncers, 1);
+    while (atomic_load(&pool->queued) == 0 && !atomic_load(&pool->stop)
+    && !(f && atomic_load(&f->pending) == 0))
+	pthread_cond_wait(&pool->wake, &pool->idle);
+    if (f)
+	atomic_fetch_sub(&pool->syncers, 1);
+    atomic_fetch_sub(&pool->sleepers, 1);
+    pthread_mutex_unlock(&pool->idle);
+}
+
+static void run(T pool, struct worker *w, struct task *t) {
+    struct frame *parent = w->current;
+    w->current = &t->frame;
+    t->apply(t->args);
+    Pool_sync(pool);
+    w->current = parent;
+    if (atomic_fetch_sub(&t->parent->pending, 1) == 1
+    && atomic_load(&pool->syncers) > 0)
+	wakeup(pool, 1);
+    FREE(t);
+}
+
+static int work(void *cl) {
+    struct worker *w = *(struct worker **)cl;
+    T pool = w->pool;
+    self = w;
+    seed = w - pool->workers;
+    while (!atomic_load(&pool->stop)) {
+	struct task *t = next(pool, w);
+	if (t)
+	    run(pool, w, t);
+	else
+	    park(pool, NULL);
+    }
+    return 0;
+}
+
+T Pool_new(int nworkers) {
+    T pool;
+    int i;
+    assert(nworkers > 0);
+    NEW(pool);
+    pool->nworkers = nworkers;
+    pool->workers = CALLOC(nworkers, sizeof (pool->workers[0]));
+    atomic_init(&pool->root.pending, 0);
+    pool->owner = Thread_self();
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->sleepers, 0);
+    atomic_init(&pool->syncers, 0);
+    atomic_init(&pool->stop, 0);
+    pthread_mutex_init(&pool->idle, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    for (i = 0; i < nworkers; i++) {
+	struct worker *w = &pool->workers[i];
+	w->pool = pool;
+	Sem_init(&w->lock, 1);
+	w->current = &pool->root;
+	w->size = 64;
+	w->tasks = ALLOC(w->size*sizeof (w->tasks[0]));
+	w->top = w->bottom = 0;
+    }
+    for (i = 1; i < nworkers; i++) {
+	struct worker *w = &pool->workers[i];
+	w->thread = Thread_new(work, &w, sizeof w, NULL);
+    }
+    return pool;
+}
+
+void Pool_spawn(T pool, int apply(void *), void *args, int nbytes) {
+    struct worker *w;
+    struct task *t;
+    assert(pool);
+    assert(apply);
+    assert(nbytes >= 0);
+    w = me(pool);
+    if (args == NULL)
+	nbytes = 0;
+    t = ALLOC(sizeof (*t) + nbytes);
+    t->apply = apply;
+    if (nbytes > 0) {
+	t->args = t + 1;
+	memcpy(t->args, args, nbytes);
+    }
+    else
+	t->args = args;
+    t->parent = w->current;
+    atomic_init(&t->frame.pending, 0);
+    atomic_fetch_add(&w->current->pending, 1);
+    push(w, t);
+    atomic_fetch_add(&pool->queued, 1);
+    if (atomic_load(&pool->sleepers) > 0)
+	wakeup(pool, 0);
+}
+
+void Pool_sync(T pool) {
+    struct worker *w;
+    assert(pool);
+    w = me(pool);
+    while (atomic_load(&w->current->pending) > 0) {
+	struct task *t = next(pool, w);
+	if (t)
+	    run(pool, w, t);
+	else
+	    park(pool, w->current);
+    }
+}
+
+void Pool_free(T *pool) {
+    int i;
+    assert(pool && *pool);
+    Pool_sync(*pool);
+    atomic_store(&(*pool)->stop, 1);
+    wakeup(*pool, 1);
+    for (i = 1; i < (*pool)->nworkers; i++)
+	Thread_join((*pool)->workers[i].thread);
+    for (i = 0; i < (*pool)->nworkers; i++)
+	FREE((*pool)->workers[i].tasks);
+    FREE((*pool)->workers);
+    pthread_mutex_destroy(&(*pool)->idle);
+    pthread_cond_destroy(&(*pool)->wake);
+    FREE(*pool);
+}
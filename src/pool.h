@@ -0,0 +1,19 @@
+#ifndef POOL_INCLUDED
+#define POOL_INCLUDED
+
+#define T Pool_T
+
+typedef struct T *T;
+
+extern T Pool_new (int nworkers);
+
+extern void Pool_free (T *pool);
+
+extern void Pool_spawn(T pool, int apply(void *),
+    void *args, int nbytes);
+
+extern void Pool_sync (T pool);
+
+#undef T
+
+#endif
@@ -0,0 +1,568 @@
+#include <stdint.h>
+#include <string.h>
+#include "assert.h"
+#include "bit.h"
+#include "mem.h"
+#include "roar.h"
+
+#define T Roar_T
+
+#define ARRAY  0
+#define BITMAP 1
+#define RUN    2
+
+#define MAXARRAY 4096
+
+#define WORDS 1024
+
+#define OR     0
+#define AND    1
+#define ANDNOT 2
+#define XOR    3
+
+struct container {
+    unsigned key;
+    int type, n, size;
+    void *data;
+};
+
+struct T {
+    int n, size;
+    struct container *c;
+};
+
+static int pop(uint64_t x) {
+#if defined(__GNUC__) && defined(__POPCNT__)
+    return __builtin_popcountll(x);
+#else
+    x -= (x>>1)&0x5555555555555555;
+    x = (x&0x3333333333333333) + ((x>>2)&0x3333333333333333);
+    x = (x + (x>>4))&0x0F0F0F0F0F0F0F0F;
+    return (int)((x*0x0101010101010101)>>56);
+#endif
+}
+
+static int ctz(uint64_t x) {
+#ifdef __GNUC__
+    return __builtin_ctzll(x);
+#else
+    int n;
+    for (n = 0; (x&1) == 0; n++)
+	x >>= 1;
+    return n;
+#endif
+}
+
+static int next(uint64_t *w, int v, int bit) {
+    int i = v/64;
+    uint64_t x;
+    if (v >= 65536)
+	return 65536;
+    x = (bit ? w[i] : ~w[i])&(~(uint64_t)0<<(v%64));
+    while (x == 0)
+	if (++i == WORDS)
+	    return 65536;
+	else
+	    x = bit ? w[i] : ~w[i];
+    return i*64 + ctz(x);
+}
+
+static void setrange(uint64_t *w, int lo, int hi) {
+    for ( ; lo <= hi && lo%64; lo++)
+	w[lo/64] |= (uint64_t)1<<(lo%64);
+    for ( ; lo + 63 <= hi; lo += 64)
+	w[lo/64] = ~(uint64_t)0;
+    for ( ; lo <= hi; lo++)
+	w[lo/64] |= (uint64_t)1<<(lo%64);
+}
+
+static long card(struct container *c) {
+    if (c->type == RUN) {
+	int i;
+	long n = 0;
+	unsigned short *r = c->data;
+	for (i = 0; i < c->n; i++)
+	    n += r[2*i+1] + 1;
+	return n;
+    }
+    return c->n;
+}
+
+static void tobits(struct container *c, uint64_t *w) {
+    int i;
+    unsigned short *v = c->data;
+    if (c->type == BITMAP) {
+	memcpy(w, c->data, WORDS*sizeof (uint64_t));
+	return;
+    }
+    memset(w, 0, WORDS*sizeof (uint64_t));
+    if (c->type == ARRAY)
+	for (i = 0; i < c->n; i++)
+	    w[v[i]/64] |= (uint64_t)1<<(v[i]%64);
+    else
+	for (i = 0; i < c->n; i++)
+	    setrange(w, v[2*i], v[2*i] + v[2*i+1]);
+}
+
+static void frombits(struct container *c, uint64_t *w) {
+    int i, n = 0;
+    for (i = 0; i < WORDS; i++)
+	n += pop(w[i]);
+    FREE(c->data);
+    c->n = n;
+    if (n > MAXARRAY) {
+	c->type = BITMAP;
+	c->size = WORDS;
+	c->data = ALLOC(WORDS*sizeof (uint64_t));
+	memcpy(c->data, w, WORDS*sizeof (uint64_t));
+    } else {
+	unsigned short *v;
+	c->type = ARRAY;
+	c->size = n > 0 ? n : 1;
+	c->data = v = ALLOC(c->size*sizeof (unsigned short));
+	for (n = 0, i = 0; i < WORDS; i++) {
+	    uint64_t x;
+	    for (x = w[i]; x; x &= x - 1)
+		v[n++] = i*64 + ctz(x);
+	}
+    }
+}
+
+static int search(unsigned short *v, int n, unsigned x) {
+    int lo = 0, hi = n;
+    while (lo < hi) {
+	int mid = (lo + hi)/2;
+	if (v[mid] < x)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+static int has(struct container *c, unsigned x) {
+    unsigned short *v = c->data;
+    if (c->type == BITMAP)
+	return (((uint64_t *)c->data)[x/64]>>(x%64))&1;
+    else if (c->type == ARRAY) {
+	int i = search(v, c->n, x);
+	return i < c->n && v[i] == x;
+    } else {
+	int lo = 0, hi = c->n;
+	while (lo < hi) {
+	    int mid = (lo + hi)/2;
+	    if (v[2*mid] <= x)
+		lo = mid + 1;
+	    else
+		hi = mid;
+	}
+	return lo > 0 && x <= (unsigned)v[2*lo-2] + v[2*lo-1];
+    }
+}
+
+static void decompress(struct container *c) {
+    uint64_t w[WORDS];
+    tobits(c, w);
+    frombits(c, w);
+}
+
+static int add(struct container *c, unsigned x) {
+    if (c->type == RUN)
+	decompress(c);
+    if (c->type == BITMAP) {
+	uint64_t *w = c->data, bit = (uint64_t)1<<(x%64);
+	if (w[x/64]&bit)
+	    return 1;
+	w[x/64] |= bit;
+	c->n++;
+    } else {
+	unsigned short *v = c->data;
+	int i = search(v, c->n, x);
+	if (i < c->n && v[i] == x)
+	    return 1;
+	if (c->n == MAXARRAY) {
+	    uint64_t w[WORDS];
+	    tobits(c, w);
+	    w[x/64] |= (uint64_t)1<<(x%64);
+	    frombits(c, w);
+	    return 0;
+	}
+	if (c->n == c->size) {
+	    c->size = 2*c->size > MAXARRAY ? MAXARRAY : 2*c->size;
+	    RESIZE(c->data, c->size*sizeof (unsigned short));
+	    v = c->data;
+	}
+	memmove(&v[i+1], &v[i], (c->n - i)*sizeof (unsigned short));
+	v[i] = x;
+	c->n++;
+    }
+    return 0;
+}
+
+static int del(struct container *c, unsigned x) {
+    if (c->type == RUN)
+	decompress(c);
+    if (c->type == BITMAP) {
+	uint64_t *w = c->data, bit = (uint64_t)1<<(x%64);
+	if ((w[x/64]&bit) == 0)
+	    return 0;
+	w[x/64] &= ~bit;
+	if (--c->n <= MAXARRAY)
+	    decompress(c);
+    } else {
+	unsigned short *v = c->data;
+	int i = search(v, c->n, x);
+	if (i == c->n || v[i] != x)
+	    return 0;
+	memmove(&v[i], &v[i+1], (c->n - i - 1)*sizeof (unsigned short));
+	c->n--;
+    }
+    return 1;
+}
+
+static int find(T set, unsigned key) {
+    int lo = 0, hi = set->n;
+    while (lo < hi) {
+	int mid = (lo + hi)/2;
+	if (set->c[mid].key < key)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+static struct container *insert(T set, int i, unsigned key) {
+    struct container *c;
+    if (set->n == set->size) {
+	set->size = set->size ? 2*set->size : 4;
+	if (set->c)
+	    RESIZE(set->c, set->size*sizeof (*set->c));
+	else
+	    set->c = ALLOC(set->size*sizeof (*set->c));
+    }
+    memmove(&set->c[i+1], &set->c[i], (set->n - i)*sizeof (*set->c));
+    set->n++;
+    c = &set->c[i];
+    c->key = key;
+    c->type = ARRAY;
+    c->n = 0;
+    c->size = 4;
+    c->data = ALLOC(c->size*sizeof (unsigned short));
+    return c;
+}
+
+static void append(T set, struct container *c, uint64_t *w) {
+    struct container *z = insert(set, set->n, c->key);
+    if (w)
+	frombits(z, w);
+    else {
+	int nbytes = c->type == BITMAP ? WORDS*sizeof (uint64_t)
+	    : c->type == RUN ? 2*c->n*sizeof (unsigned short)
+	    : c->n*sizeof (unsigned short);
+	FREE(z->data);
+	z->type = c->type;
+	z->n = c->n;
+	z->size = c->type == BITMAP ? WORDS : c->n > 0 ? c->n : 1;
+	z->data = ALLOC(nbytes > 0 ? nbytes : 1);
+	memcpy(z->data, c->data, nbytes);
+    }
+    if (z->n == 0) {
+	FREE(z->data);
+	set->n--;
+    }
+}
+
+static void combine(T set, struct container *a, struct container *b, int op) {
+    uint64_t x[WORDS], y[WORDS];
+    int i;
+    if (a->type == ARRAY && b->type == ARRAY
+    && ((op != OR && op != XOR) || a->n + b->n <= MAXARRAY)) {
+	unsigned short *u = a->data, *v = b->data, z[MAXARRAY];
+	int j = 0, k = 0, n = 0;
+	struct container c;
+	while (j < a->n || k < b->n)
+	    if (k == b->n || (j < a->n && u[j] < v[k])) {
+		if (op != AND)
+		    z[n++] = u[j];
+		j++;
+	    } else if (j == a->n || v[k] < u[j]) {
+		if (op == OR || op == XOR)
+		    z[n++] = v[k];
+		k++;
+	    } else {
+		if (op == OR || op == AND)
+		    z[n++] = u[j];
+		j++;
+		k++;
+	    }
+	c.key = a->key;
+	c.type = ARRAY;
+	c.n = n;
+	c.data = z;
+	append(set, &c, NULL);
+	return;
+    }
+    if (a->type == BITMAP && b->type == BITMAP) {
+	uint64_t *u = a->data, *v = b->data, *w;
+	struct container *z = insert(set, set->n, a->key);
+	FREE(z->data);
+	z->type = BITMAP;
+	z->size = WORDS;
+	z->data = w = ALLOC(WORDS*sizeof (uint64_t));
+	for (i = 0; i < WORDS; i++) {
+	    switch (op) {
+	    case OR:     w[i] = u[i] | v[i];  break;
+	    case AND:    w[i] = u[i] & v[i];  break;
+	    case ANDNOT: w[i] = u[i] & ~v[i]; break;
+	    case XOR:    w[i] = u[i] ^ v[i];  break;
+	    }
+	    z->n += pop(w[i]);
+	}
+	if (z->n == 0) {
+	    FREE(z->data);
+	    set->n--;
+	} else if (z->n <= MAXARRAY)
+	    decompress(z);
+	return;
+    }
+    tobits(a, x);
+    tobits(b, y);
+    for (i = 0; i < WORDS; i++)
+	switch (op) {
+	case OR:     x[i] |= y[i];  break;
+	case AND:    x[i] &= y[i];  break;
+	case ANDNOT: x[i] &= ~y[i]; break;
+	case XOR:    x[i] ^= y[i];  break;
+	}
+    append(set, a, x);
+}
+
+static T setop(T s, T t, int op) {
+    T set;
+    int i = 0, j = 0, m, n;
+    assert(s || t);
+    m = s ? s->n : 0;
+    n = t ? t->n : 0;
+    set = Roar_new();
+    while (i < m || j < n)
+	if (j == n || (i < m && s->c[i].key < t->c[j].key)) {
+	    if (op != AND)
+		append(set, &s->c[i], NULL);
+	    i++;
+	} else if (i == m || t->c[j].key < s->c[i].key) {
+	    if (op == OR || op == XOR)
+		append(set, &t->c[j], NULL);
+	    j++;
+	} else
+	    combine(set, &s->c[i++], &t->c[j++], op);
+    return set;
+}
+
+static int subset(struct container *a, struct container *b) {
+    uint64_t x[WORDS], y[WORDS];
+    int i;
+    if (card(a) > card(b))
+	return 0;
+    if (a->type == ARRAY) {
+	unsigned short *v = a->data;
+	for (i = 0; i < a->n; i++)
+	    if (!has(b, v[i]))
+		return 0;
+	return 1;
+    }
+    tobits(a, x);
+    tobits(b, y);
+    for (i = 0; i < WORDS; i++)
+	if (x[i]&~y[i])
+	    return 0;
+    return 1;
+}
+
+T Roar_new(void) {
+    T set;
+    NEW(set);
+    set->n = 0;
+    set->size = 0;
+    set->c = NULL;
+    return set;
+}
+
+void Roar_free(T *set) {
+    int i;
+    assert(set && *set);
+    for (i = 0; i < (*set)->n; i++)
+	FREE((*set)->c[i].data);
+    FREE((*set)->c);
+    FREE(*set);
+}
+
+long Roar_count(T set) {
+    int i;
+    long n = 0;
+    assert(set);
+    for (i = 0; i < set->n; i++)
+	n += card(&set->c[i]);
+    return n;
+}
+
+int Roar_get(T set, unsigned n) {
+    int i;
+    assert(set);
+    i = find(set, n>>16);
+    return i < set->n && set->c[i].key == n>>16
+	&& has(&set->c[i], n&0xFFFF);
+}
+
+int Roar_put(T set, unsigned n, int bit) {
+    int i, prev;
+    assert(set);
+    assert(bit == 0 || bit == 1);
+    i = find(set, n>>16);
+    if (i == set->n || set->c[i].key != n>>16) {
+	if (bit == 0)
+	    return 0;
+	insert(set, i, n>>16);
+    }
+    if (bit == 1)
+	return add(&set->c[i], n&0xFFFF);
+    prev = del(&set->c[i], n&0xFFFF);
+    if (set->c[i].n == 0) {
+	FREE(set->c[i].data);
+	memmove(&set->c[i], &set->c[i+1],
+	    (set->n - i - 1)*sizeof (*set->c));
+	set->n--;
+    }
+    return prev;
+}
+
+void Roar_optimize(T set) {
+    int i;
+    assert(set);
+    for (i = 0; i < set->n; i++) {
+	struct container *c = &set->c[i];
+	uint64_t w[WORDS];
+	int j, v, runs = 0, nbytes = c->type == BITMAP
+	    ? WORDS*sizeof (uint64_t) : c->n*sizeof (unsigned short);
+	unsigned short *r;
+	if (c->type == RUN)
+	    continue;
+	tobits(c, w);
+	for (j = 0; j < WORDS; j++)
+	    runs += pop(w[j]&~(w[j]<<1 | (j ? w[j-1]>>63 : 0)));
+	if (4*runs >= nbytes)
+	    continue;
+	FREE(c->data);
+	c->type = RUN;
+	c->n = c->size = runs;
+	c->data = r = ALLOC(2*runs*sizeof (unsigned short));
+	for (j = 0, v = next(w, 0, 1); v < 65536; v = next(w, v, 1)) {
+	    int end = next(w, v, 0);
+	    r[2*j] = v;
+	    r[2*j+1] = end - v - 1;
+	    j++;
+	    v = end;
+	}
+    }
+}
+
+int Roar_leq(T s, T t) {
+    int i, j = 0;
+    assert(s && t);
+    for (i = 0; i < s->n; i++) {
+	while (j < t->n && t->c[j].key < s->c[i].key)
+	    j++;
+	if (j == t->n || t->c[j].key != s->c[i].key
+	|| !subset(&s->c[i], &t->c[j]))
+	    return 0;
+    }
+    return 1;
+}
+
+int Roar_eq(T s, T t) {
+    assert(s && t);
+    return Roar_count(s) == Roar_count(t) && Roar_leq(s, t);
+}
+
+int Roar_lt(T s, T t) {
+    assert(s && t);
+    return Roar_count(s) < Roar_count(t) && Roar_leq(s, t);
+}
+
+void Roar_map(T set, void apply(unsigned n, void *cl), void *cl) {
+    int i, j;
+    assert(set);
+    assert(apply);
+    for (i = 0; i < set->n; i++) {
+	struct container *c = &set->c[i];
+	unsigned key = c->key<<16;
+	unsigned short *v = c->data;
+	if (c->type == ARRAY)
+	    for (j = 0; j < c->n; j++)
+		apply(key | v[j], cl);
+	else if (c->type == BITMAP)
+	    for (j = 0; j < WORDS; j++) {
+		uint64_t x;
+		for (x = ((uint64_t *)c->data)[j]; x; x &= x - 1)
+		    apply(key | (j*64 + ctz(x)), cl);
+	    }
+	else
+	    for (j = 0; j < c->n; j++) {
+		unsigned k;
+		for (k = v[2*j]; k <= (unsigned)v[2*j] + v[2*j+1]; k++)
+		    apply(key | k, cl);
+	    }
+    }
+}
+
+T Roar_union(T s, T t) {
+    return setop(s, t, OR);
+}
+
+T Roar_inter(T s, T t) {
+    return setop(s, t, AND);
+}
+
+T Roar_minus(T s, T t) {
+    return setop(s, t, ANDNOT);
+}
+
+T Roar_diff(T s, T t) {
+    return setop(s, t, XOR);
+}
+
+T Roar_frombit(Bit_T set) {
+    T z;
+    int n;
+    assert(set);
+    z = Roar_new();
+    for (n = Bit_next_set(set, 0); n >= 0;
+	n = Bit_next_set(set, n + 1))
+	Roar_put(z, n, 1);
+    return z;
+}
+
+Bit_T Roar_tobit(T set, int length) {
+    Bit_T z;
+    int i, j;
+    assert(set);
+    z = Bit_new(length);
+    for (i = 0; i < set->n; i++) {
+	struct container *c = &set->c[i];
+	unsigned key = c->key<<16;
+	unsigned short *v = c->data;
+	if (c->type == RUN)
+	    for (j = 0; j < c->n; j++)
+		Bit_set(z, key | v[2*j], key | (v[2*j] + v[2*j+1]));
+	else if (c->type == ARRAY)
+	    for (j = 0; j < c->n; j++)
+		Bit_put(z, key | v[j], 1);
+	else
+	    for (j = 0; j < WORDS; j++) {
+		uint64_t x;
+		for (x = ((uint64_t *)c->data)[j]; x; x &= x - 1)
+		    Bit_put(z, key | (j*64 + ctz(x)), 1);
+	    }
+    }
+    return z;
+}
@@ -0,0 +1,44 @@
+#ifndef ROAR_INCLUDED
+#define ROAR_INCLUDED
+
+#include "bit.h"
+
+#define T Roar_T
+
+typedef struct T *T;
+
+extern T Roar_new(void);
+
+extern void Roar_free(T *set);
+
+extern long Roar_count(T set);
+
+extern int Roar_get(T set, unsigned n);
+
+extern int Roar_put(T set, unsigned n, int bit);
+
+extern void Roar_optimize(T set);
+
+extern int Roar_lt(T s, T t);
+
+extern int Roar_eq(T s, T t);
+
+extern int Roar_leq(T s, T t);
+
+extern void Roar_map(T set, void apply(unsigned n, void *cl), void *cl);
+
+extern T Roar_union(T s, T t);
+
+extern T Roar_inter(T s, T t);
+
+extern T Roar_minus(T s, T t);
+
+extern T Roar_diff(T s, T t);
+
+extern T Roar_frombit(Bit_T set);
+
+extern Bit_T Roar_tobit(T set, int length);
+
+#undef T
+
+#endif
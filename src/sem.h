@@ -0,0 +1,29 @@
+#ifndef SEM_INCLUDED
+#define SEM_INCLUDED
+
+#include <pthread.h>
+
+#define T Sem_T
+
+typedef struct T {
+    int count;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} T;
+
+#define LOCK(mutex) do { Sem_T *_yymutex = &(mutex); \
+    Sem_wait(_yymutex);
+
+#define END_LOCK Sem_signal(_yymutex); } while (0)
+
+extern void Sem_init (T *s, int count);
+
+extern T *Sem_new (int count);
+
+extern void Sem_wait (T *s);
+
+extern void Sem_signal(T *s);
+
+#undef T
+
+#endif
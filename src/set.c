@@ -1,22 +1,27 @@
 #include <limits.h>
 #include <stddef.h>
+#include <string.h>
 #include "mem.h"
 #include "assert.h"
-#include "arith.h"
+#include "swiss.h"
 #include "set.h"
 
 #define T Set_T
 
+#define MAXLOAD 87
+
 struct T {
     int length;
     unsigned timestamp;
     int (*cmp)(const void *x, const void *y);
     unsigned (*hash)(const void *x);
     int size;
+    int used;
+    signed char *ctrl;
     struct member {
-	struct member *link;
 	const void *member;
-    } **buckets;
+	unsigned hash;
+    } *slots;
 };
 
 static int cmpatom(const void *x, const void *y) {
@@ -27,97 +32,148 @@ static unsigned hashatom(const void *x) {
     return (unsigned long)x>>2;
 }
 
-static T copy(T t, int hint) {
+static int sizefor(long n) {
+    int size;
+    for (size = GROUP; size < INT_MAX/2 && (long)size*MAXLOAD/100 < n; size <<= 1)
+	;
+    return size;
+}
+
+static long limit(int size) {
+    return (long)size*MAXLOAD/100;
+}
+
+static int find(T set, const void *member, unsigned h) {
+    unsigned mask = set->size - 1, pos = (h>>7)&mask, step = 0;
+    for (;;) {
+	unsigned bits = Swiss_match(set->ctrl + pos, h&0x7f);
+	for ( ; bits; bits &= bits - 1) {
+	    int i = (pos + Swiss_ctz(bits))&mask;
+	    if (set->slots[i].hash == h
+	    && (*set->cmp)(member, set->slots[i].member) == 0)
+		return i;
+	}
+	if (Swiss_match(set->ctrl + pos, EMPTY))
+	    return -1;
+	step += GROUP;
+	pos = (pos + step)&mask;
+    }
+}
+
+static void insert(T set, const void *member, unsigned h) {
+    int i = Swiss_slot(set->ctrl, set->size, h);
+    if (set->ctrl[i] == EMPTY)
+	set->used++;
+    Swiss_setctrl(set->ctrl, set->size, i, h&0x7f);
+    set->slots[i].member = member;
+    set->slots[i].hash = h;
+    set->length++;
+}
+
+static void resize(T set, int size) {
+    int i, oldsize = set->size;
+    signed char *ctrl = set->ctrl;
+    struct member *slots = set->slots;
+    set->size = size;
+    set->ctrl = ALLOC(size + GROUP);
+    memset(set->ctrl, EMPTY, size + GROUP);
+    set->slots = ALLOC((long)size*sizeof (set->slots[0]));
+    set->length = set->used = 0;
+    for (i = 0; i < oldsize; i++)
+	if (ctrl[i] >= 0)
+	    insert(set, slots[i].member, slots[i].hash);
+    FREE(ctrl);
+    FREE(slots);
+}
+
+static void grow(T set) {
+    if (set->used + 1 > limit(set->size))
+	resize(set, 2L*set->length >= limit(set->size)
+	    ? 2*set->size : set->size);
+}
+
+static void add(T set, const void *member, unsigned h) {
+    int i = find(set, member, h);
+    if (i >= 0)
+	set->slots[i].member = member;
+    else {
+	grow(set);
+	insert(set, member, h);
+    }
+}
+
+static T copy(T t, long hint) {
     T set;
+    int size = sizefor(hint);
     assert(t);
-    set = Set_new(hint, t->cmp, t->hash);
-    struct member *q;
-    for (int i = 0; i < t->size; i++)
-	for (q = t->buckets[i]; q; q = q->link) {
-	    struct member *p;
-	    const void *member = q->member;
-	    int i = (*set->hash)(member)%set->size;
-	    NEW(p);
-	    p->member = member;
-	    p->link = set->buckets[i];
-	    set->buckets[i] = p;
-	    set->length++;
-	}
+    set = Set_new(0, t->cmp, t->hash);
+    if (size <= t->size) {
+	FREE(set->ctrl);
+	FREE(set->slots);
+	set->size = t->size;
+	set->ctrl = ALLOC(t->size + GROUP);
+	memcpy(set->ctrl, t->ctrl, t->size + GROUP);
+	set->slots = ALLOC((long)t->size*sizeof (set->slots[0]));
+	memcpy(set->slots, t->slots, t->size*sizeof (set->slots[0]));
+	set->length = t->length;
+	set->used = t->used;
+    }
+    else {
+	int i;
+	resize(set, size);
+	for (i = 0; i < t->size; i++)
+	    if (t->ctrl[i] >= 0)
+		insert(set, t->slots[i].member, t->slots[i].hash);
+    }
     return set;
 }
 
+static void erase(T set, int i) {
+    Swiss_setctrl(set->ctrl, set->size, i, DELETED);
+    set->length--;
+}
+
 T Set_new(int hint,
 	int cmp(const void *x, const void *y),
 	unsigned hash(const void *x)) {
     T set;
-    int i;
-    static int primes[] = { 509, 509, 1021, 2053, 4093,
-	8191, 16381, 32771, 65521, INT_MAX };
     assert(hint >= 0);
-    for (i = 1; primes[i] < hint; i++)
-	;
-    set = ALLOC(sizeof (*set) + primes[i-1]*sizeof (set->buckets[0]));
-    set->size = primes[i-1];
+    NEW(set);
+    set->size = sizefor(hint);
     set->cmp  = cmp  ?  cmp : cmpatom;
     set->hash = hash ? hash : hashatom;
-    set->buckets = (struct member **)(set + 1);
-    for (i = 0; i < set->size; i++)
-	set->buckets[i] = NULL;
+    set->ctrl = ALLOC(set->size + GROUP);
+    memset(set->ctrl, EMPTY, set->size + GROUP);
+    set->slots = ALLOC((long)set->size*sizeof (set->slots[0]));
     set->length = 0;
+    set->used = 0;
     set->timestamp = 0;
     return set;
 }
 
 int Set_member(T set, const void *member) {
-    int i;
-    struct member *p;
     assert(set);
     assert(member);
-    i = (*set->hash)(member)%set->size;
-    for (p = set->buckets[i]; p; p = p->link)
-	if ((*set->cmp)(member, p->member) == 0)
-	    break;
-    return p != NULL;
+    return find(set, member, Swiss_mix((*set->hash)(member))) >= 0;
 }
 
 void Set_put(T set, const void *member) {
-    int i;
-    struct member *p;
     assert(set);
     assert(member);
-    i = (*set->hash)(member)%set->size;
-    for (p = set->buckets[i]; p; p = p->link)
-	if ((*set->cmp)(member, p->member) == 0)
-	    break;
-    if (p == NULL) {
-	NEW(p);
-	p->member = member;
-	p->link = set->buckets[i];
-	set->buckets[i] = p;
-	set->length++;
-    }
-    else
-	p->member = member;
+    add(set, member, Swiss_mix((*set->hash)(member)));
     set->timestamp++;
 }
 
 void *Set_remove(T set, const void *member) {
     int i;
-    struct member **pp;
     assert(set);
     assert(member);
     set->timestamp++;
-    i = (*set->hash)(member)%set->size;
-    for (pp = &set->buckets[i]; *pp; pp = &(*pp)->link)
-	if ((*set->cmp)(member, (*pp)->member) == 0) {
-	    struct member *p = *pp;
-	    *pp = p->link;
-	    member = p->member;
-	    FREE(p);
-	    set->length--;
-	    return (void *)member;
-	}
-    return NULL;
+    i = find(set, member, Swiss_mix((*set->hash)(member)));
+    if (i < 0)
+	return NULL;
+    erase(set, i);
+    return (void *)set->slots[i].member;
 }
 
 int Set_length(T set) {
@@ -127,15 +183,8 @@ int Set_length(T set) {
 
 void Set_free(T *set) {
     assert(set && *set);
-    if ((*set)->length > 0) {
-	int i;
-	struct member *p, *q;
-	for (i = 0; i < (*set)->size; i++)
-	    for (p = (*set)->buckets[i]; p; p = q) {
-		q = p->link;
-		FREE(p);
-	    }
-    }
+    FREE((*set)->ctrl);
+    FREE((*set)->slots);
     FREE(*set);
 }
 
@@ -143,13 +192,12 @@ void Set_map(T set,
 	void apply(const void *member, void *cl), void *cl) {
     int i;
     unsigned stamp;
-    struct member *p;
     assert(set);
     assert(apply);
     stamp = set->timestamp;
     for (i = 0; i < set->size; i++)
-	for (p = set->buckets[i]; p; p = p->link) {
-	    apply(p->member, cl);
+	if (set->ctrl[i] >= 0) {
+	    apply(set->slots[i].member, cl);
 	    assert(set->timestamp == stamp);
 	}
 }
@@ -157,12 +205,11 @@ void Set_map(T set,
 void **Set_toArray(T set, void *end) {
     int i, j = 0;
     void **array;
-    struct member *p;
     assert(set);
     array = ALLOC((set->length + 1)*sizeof (*array));
     for (i = 0; i < set->size; i++)
-	for (p = set->buckets[i]; p; p = p->link)
-	    array[j++] = (void *)p->member;
+	if (set->ctrl[i] >= 0)
+	    array[j++] = (void *)set->slots[i].member;
     array[j] = end;
     return array;
 }
@@ -170,17 +217,29 @@ void **Set_toArray(T set, void *end) {
 T Set_union(T s, T t) {
     if (s == NULL) {
 	assert(t);
-	return copy(t, t->size);
+	return copy(t, t->length);
     }
     else if (t == NULL)
-	return copy(s, s->size);
+	return copy(s, s->length);
     else {
-	T set = copy(s, Arith_max(s->size, t->size));
+	int i;
+	T set;
 	assert(s->cmp == t->cmp && s->hash == t->hash);
-	struct member *q;
-	for (int i = 0; i < t->size; i++)
-	    for (q = t->buckets[i]; q; q = q->link)
-		Set_put(set, q->member);
+	if (s->length >= t->length) {
+	    set = copy(s, (long)s->length + t->length);
+	    for (i = 0; i < t->size; i++)
+		if (t->ctrl[i] >= 0)
+		    add(set, t->slots[i].member, t->slots[i].hash);
+	}
+	else {
+	    set = copy(t, (long)s->length + t->length);
+	    for (i = 0; i < s->size; i++)
+		if (s->ctrl[i] >= 0
+		&& find(set, s->slots[i].member, s->slots[i].hash) < 0) {
+		    grow(set);
+		    insert(set, s->slots[i].member, s->slots[i].hash);
+		}
+	}
 	return set;
     }
 }
@@ -188,29 +247,30 @@ T Set_union(T s, T t) {
 T Set_inter(T s, T t) {
     if (s == NULL) {
 	assert(t);
-	return Set_new(t->size, t->cmp, t->hash);
+	return Set_new(0, t->cmp, t->hash);
     }
     else if (t == NULL)
-	return Set_new(s->size, s->cmp, s->hash);
-    else if (s->length < t->length)
-	return Set_inter(t, s);
+	return Set_new(0, s->cmp, s->hash);
+    else if (s->length < t->length) {
+	int i;
+	T set = Set_new(s->length, s->cmp, s->hash);
+	assert(s->cmp == t->cmp && s->hash == t->hash);
+	for (i = 0; i < s->size; i++)
+	    if (s->ctrl[i] >= 0) {
+		int j = find(t, s->slots[i].member, s->slots[i].hash);
+		if (j >= 0)
+		    insert(set, t->slots[j].member, t->slots[j].hash);
+	    }
+	return set;
+    }
     else {
-	T set = Set_new(Arith_min(s->size, t->size),
-		s->cmp, s->hash);
+	int i;
+	T set = Set_new(t->length, s->cmp, s->hash);
 	assert(s->cmp == t->cmp && s->hash == t->hash);
-	struct member *q;
-	for (int i = 0; i < t->size; i++)
-	    for (q = t->buckets[i]; q; q = q->link)
-		if (Set_member(s, q->member)) {
-		    struct member *p;
-		    const void *member = q->member;
-		    int i = (*set->hash)(member)%set->size;
-		    NEW(p);
-		    p->member = member;
-		    p->link = set->buckets[i];
-		    set->buckets[i] = p;
-		    set->length++;
-		}
+	for (i = 0; i < t->size; i++)
+	    if (t->ctrl[i] >= 0
+	    && find(s, t->slots[i].member, t->slots[i].hash) >= 0)
+		insert(set, t->slots[i].member, t->slots[i].hash);
 	return set;
     }
 }
@@ -218,27 +278,30 @@ T Set_inter(T s, T t) {
 T Set_minus(T t, T s) {
     if (t == NULL){
 	assert(s);
-	return Set_new(s->size, s->cmp, s->hash);
+	return Set_new(0, s->cmp, s->hash);
     }
     else if (s == NULL)
-	return copy(t, t->size);
+	return copy(t, t->length);
     else {
-	T set = Set_new(Arith_min(s->size, t->size),
-		s->cmp, s->hash);
+	int i;
+	T set;
 	assert(s->cmp == t->cmp && s->hash == t->hash);
-	struct member *q;
-	for (int i = 0; i < t->size; i++)
-	    for (q = t->buckets[i]; q; q = q->link)
-		if (!Set_member(s, q->member)) {
-		    struct member *p;
-		    const void *member = q->member;
-		    int i = (*set->hash)(member)%set->size;
-		    NEW(p);
-		    p->member = member;
-		    p->link = set->buckets[i];
-		    set->buckets[i] = p;
-		    set->length++;
+	if (s->length < t->length) {
+	    set = copy(t, t->length);
+	    for (i = 0; i < s->size; i++)
+		if (s->ctrl[i] >= 0) {
+		    int j = find(set, s->slots[i].member, s->slots[i].hash);
+		    if (j >= 0)
+			erase(set, j);
 		}
+	}
+	else {
+	    set = Set_new(t->length, s->cmp, s->hash);
+	    for (i = 0; i < t->size; i++)
+		if (t->ctrl[i] >= 0
+		&& find(s, t->slots[i].member, t->slots[i].hash) < 0)
+		    insert(set, t->slots[i].member, t->slots[i].hash);
+	}
 	return set;
     }
 }
@@ -246,44 +309,27 @@ T Set_minus(T t, T s) {
 T Set_diff(T s, T t) {
     if (s == NULL) {
 	assert(t);
-	return copy(t, t->size);
+	return copy(t, t->length);
     }
     else if (t == NULL)
-	return copy(s, s->size);
+	return copy(s, s->length);
     else {
-	T set = Set_new(Arith_min(s->size, t->size),
-		s->cmp, s->hash);
+	int i;
+	T set;
 	assert(s->cmp == t->cmp && s->hash == t->hash);
-	struct member *q;
-	for (int i = 0; i < t->size; i++)
-	    for (q = t->buckets[i]; q; q = q->link)
-		if (!Set_member(s, q->member))
-		{
-		    struct member *p;
-		    const void *member = q->member;
-		    int i = (*set->hash)(member)%set->size;
-		    NEW(p);
-		    p->member = member;
-		    p->link = set->buckets[i];
-		    set->buckets[i] = p;
-		    set->length++;
+	if (s->length < t->length)
+	    { T u = t; t = s; s = u; }
+	set = copy(s, (long)s->length + t->length);
+	for (i = 0; i < t->size; i++)
+	    if (t->ctrl[i] >= 0) {
+		int j = find(set, t->slots[i].member, t->slots[i].hash);
+		if (j >= 0)
+		    erase(set, j);
+		else {
+		    grow(set);
+		    insert(set, t->slots[i].member, t->slots[i].hash);
 		}
-	{ T u = t; t = s; s = u; }
-	{
-	    struct member *q;
-	    for (int i = 0; i < t->size; i++)
-		for (q = t->buckets[i]; q; q = q->link)
-		    if (!Set_member(s, q->member)) {
-			struct member *p;
-			const void *member = q->member;
-			int i = (*set->hash)(member)%set->size;
-			NEW(p);
-			p->member = member;
-			p->link = set->buckets[i];
-			set->buckets[i] = p;
-			set->length++;
-		    }
-	}
+	    }
 	return set;
     }
 }
@@ -0,0 +1,78 @@
+#ifndef SWISS_INCLUDED
+#define SWISS_INCLUDED
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define GROUP 16
+#define EMPTY ((signed char)-128)
+#define DELETED ((signed char)-2)
+
+static inline unsigned Swiss_mix(unsigned h) {
+    h ^= h>>16;
+    h *= 0x7feb352dU;
+    h ^= h>>15;
+    h *= 0x846ca68bU;
+    h ^= h>>16;
+    return h;
+}
+
+static inline int Swiss_ctz(unsigned bits) {
+#ifdef __GNUC__
+    return __builtin_ctz(bits);
+#else
+    int n;
+    for (n = 0; (bits&1) == 0; n++)
+	bits >>= 1;
+    return n;
+#endif
+}
+
+#ifdef __SSE2__
+static inline unsigned Swiss_match(const signed char *group, signed char c) {
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(c), ctrl));
+}
+
+static inline unsigned Swiss_matchfree(const signed char *group) {
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+}
+#else
+static inline unsigned Swiss_match(const signed char *group, signed char c) {
+    unsigned bits = 0;
+    int i;
+    for (i = 0; i < GROUP; i++)
+	if (group[i] == c)
+	    bits |= 1U<<i;
+    return bits;
+}
+
+static inline unsigned Swiss_matchfree(const signed char *group) {
+    unsigned bits = 0;
+    int i;
+    for (i = 0; i < GROUP; i++)
+	if (group[i] < 0)
+	    bits |= 1U<<i;
+    return bits;
+}
+#endif
+
+static inline void Swiss_setctrl(signed char *ctrl, int size, int i,
+	signed char c) {
+    ctrl[i] = c;
+    if (i < GROUP)
+	ctrl[size + i] = c;
+}
+
+static inline int Swiss_slot(const signed char *ctrl, int size, unsigned h) {
+    unsigned mask = size - 1, pos = (h>>7)&mask, step = 0;
+    for (;;) {
+	unsigned bits = Swiss_matchfree(ctrl + pos);
+	if (bits)
+	    return (pos + Swiss_ctz(bits))&mask;
+	step += GROUP;
+	pos = (pos + step)&mask;
+    }
+}
+
+#endif
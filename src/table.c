@@ -1,24 +1,49 @@
 #include <limits.h>
 #include <stddef.h>
+#include <string.h>
 #include "mem.h"
 #include "assert.h"
+#include "swiss.h"
 #include "table.h"
 
 #define T Table_T
 
+#define MAXLOAD 100
+#define PUTSTEP 4
+#define REMOVESTEP 1
+
+#define FLATLOAD 87
+
 struct T {
     int size;
     int (*cmp)(const void *x, const void *y);
     unsigned (*hash)(const void *key);
     int length;
     unsigned timestamp;
+    int load;
     struct binding {
 	struct binding *link;
 	const void *key;
 	void *value;
+	unsigned hash;
     } **buckets;
+    int oldsize;
+    int rehash;
+    struct binding **old;
+    signed char *ctrl;
+    struct slot {
+	const void *key;
+	void *value;
+	unsigned hash;
+    } *slots;
+    int used;
 };
 
+static int primes[] = { 509, 509, 1021, 2039, 4093,
+    8191, 16381, 32749, 65521, 131071, 262139, 524287,
+    1048573, 2097143, 4194301, 8388593, 16777213, 33554393,
+    67108859, 134217689, 268435399, 536870909, 1073741789, INT_MAX };
+
 static int cmpatom(const void *x, const void *y) {
     return x != y;
 }
@@ -27,60 +52,237 @@ static unsigned hashatom(const void *key) {
     return (unsigned long)key>>2;
 }
 
+static int nextsize(long n) {
+    int i;
+    for (i = 1; primes[i] < n && primes[i+1] < INT_MAX; i++)
+	;
+    return primes[i];
+}
+
+static void rehash(T table, int n) {
+    while (table->old && n-- > 0) {
+	struct binding *p, *q;
+	for (p = table->old[table->rehash]; p; p = q) {
+	    int i = p->hash%table->size;
+	    q = p->link;
+	    p->link = table->buckets[i];
+	    table->buckets[i] = p;
+	}
+	if (++table->rehash == table->oldsize) {
+	    FREE(table->old);
+	    table->oldsize = 0;
+	    table->rehash = 0;
+	}
+    }
+}
+
+static void resize(T table, int size) {
+    rehash(table, table->oldsize);
+    if (size <= table->size)
+	return;
+    table->old = table->buckets;
+    table->oldsize = table->size;
+    table->rehash = 0;
+    table->buckets = CALLOC(size, sizeof (table->buckets[0]));
+    table->size = size;
+}
+
+static long flatlimit(T table, int size) {
+    return (long)size*(table->load < FLATLOAD ? table->load : FLATLOAD)/100;
+}
+
+static int flatfind(T table, const void *key, unsigned h) {
+    unsigned mask = table->size - 1, pos = (h>>7)&mask, step = 0;
+    for (;;) {
+	unsigned bits = Swiss_match(table->ctrl + pos, h&0x7f);
+	for ( ; bits; bits &= bits - 1) {
+	    int i = (pos + Swiss_ctz(bits))&mask;
+	    if (table->slots[i].hash == h
+	    && (*table->cmp)(key, table->slots[i].key) == 0)
+		return i;
+	}
+	if (Swiss_match(table->ctrl + pos, EMPTY))
+	    return -1;
+	step += GROUP;
+	pos = (pos + step)&mask;
+    }
+}
+
+static void flatresize(T table, int size) {
+    int i, oldsize = table->size;
+    signed char *ctrl = table->ctrl;
+    struct slot *slots = table->slots;
+    table->size = size;
+    table->ctrl = ALLOC(size + GROUP);
+    memset(table->ctrl, EMPTY, size + GROUP);
+    table->slots = ALLOC((long)size*sizeof (table->slots[0]));
+    table->used = table->length;
+    for (i = 0; i < oldsize; i++)
+	if (ctrl[i] >= 0) {
+	    int j = Swiss_slot(table->ctrl, table->size, slots[i].hash);
+	    Swiss_setctrl(table->ctrl, table->size, j, slots[i].hash&0x7f);
+	    table->slots[j] = slots[i];
+	}
+    FREE(ctrl);
+    FREE(slots);
+}
+
+static void *flatput(T table, const void *key, void *value) {
+    unsigned h = Swiss_mix((*table->hash)(key));
+    int i = flatfind(table, key, h);
+    void *prev;
+    if (i < 0) {
+	if (table->used + 1 > flatlimit(table, table->size))
+	    flatresize(table, 2L*table->length >= flatlimit(table, table->size)
+		? 2*table->size : table->size);
+	i = Swiss_slot(table->ctrl, table->size, h);
+	if (table->ctrl[i] == EMPTY)
+	    table->used++;
+	Swiss_setctrl(table->ctrl, table->size, i, h&0x7f);
+	table->slots[i].key = key;
+	table->slots[i].hash = h;
+	table->length++;
+	prev = NULL;
+    }
+    else
+	prev = table->slots[i].value;
+    table->slots[i].value = value;
+    table->timestamp++;
+    return prev;
+}
+
+static void *flatremove(T table, const void *key) {
+    int i = flatfind(table, key, Swiss_mix((*table->hash)(key)));
+    if (i < 0)
+	return NULL;
+    Swiss_setctrl(table->ctrl, table->size, i, DELETED);
+    table->length--;
+    return table->slots[i].value;
+}
+
+static struct binding **lookup(T table, const void *key, unsigned h) {
+    struct binding **pp;
+    if (table->old && (int)(h%table->oldsize) >= table->rehash)
+	for (pp = &table->old[h%table->oldsize]; *pp; pp = &(*pp)->link)
+	    if ((*pp)->hash == h && (*table->cmp)(key, (*pp)->key) == 0)
+		return pp;
+    for (pp = &table->buckets[h%table->size]; *pp; pp = &(*pp)->link)
+	if ((*pp)->hash == h && (*table->cmp)(key, (*pp)->key) == 0)
+	    return pp;
+    return NULL;
+}
+
 T Table_new(int hint,
     int cmp(const void *x, const void *y),
     unsigned hash(const void *key)) {
     T table;
     int i;
-    static int primes[] = { 509, 509, 1021, 2053, 4093,
-	8191, 16381, 32771, 65521, INT_MAX };
     assert(hint >= 0);
     for (i = 1; primes[i] < hint; i++)
 	;
-    table = ALLOC(sizeof (*table) + primes[i-1]*sizeof (table->buckets[0]));
+    NEW(table);
     table->size = primes[i-1];
     table->cmp  = cmp  ?  cmp : cmpatom;
     table->hash = hash ? hash : hashatom;
-    table->buckets = (struct binding **)(table + 1);
-    for (i = 0; i < table->size; i++)
-	table->buckets[i] = NULL;
+    table->buckets = CALLOC(table->size, sizeof (table->buckets[0]));
     table->length = 0;
     table->timestamp = 0;
+    table->load = MAXLOAD;
+    table->oldsize = 0;
+    table->rehash = 0;
+    table->old = NULL;
+    table->ctrl = NULL;
+    table->slots = NULL;
+    table->used = 0;
     return table;
 }
 
+T Table_new_flat(int hint,
+    int cmp(const void *x, const void *y),
+    unsigned hash(const void *key)) {
+    T table;
+    int size;
+    assert(hint >= 0);
+    for (size = GROUP; size < INT_MAX/2 && (long)size*FLATLOAD/100 < hint; size <<= 1)
+	;
+    NEW(table);
+    table->size = size;
+    table->cmp  = cmp  ?  cmp : cmpatom;
+    table->hash = hash ? hash : hashatom;
+    table->buckets = NULL;
+    table->length = 0;
+    table->timestamp = 0;
+    table->load = FLATLOAD;
+    table->oldsize = 0;
+    table->rehash = 0;
+    table->old = NULL;
+    table->ctrl = ALLOC(size + GROUP);
+    memset(table->ctrl, EMPTY, size + GROUP);
+    table->slots = ALLOC((long)size*sizeof (table->slots[0]));
+    table->used = 0;
+    return table;
+}
+
+void Table_maxload(T table, int load) {
+    assert(table);
+    assert(load > 0);
+    table->load = load;
+}
+
+void Table_reserve(T table, int n) {
+    assert(table);
+    assert(n >= 0);
+    if (table->ctrl) {
+	int size;
+	for (size = table->size; size < INT_MAX/2 && flatlimit(table, size) < n; size <<= 1)
+	    ;
+	if (size > table->size)
+	    flatresize(table, size);
+	return;
+    }
+    resize(table, nextsize((long)n*100/table->load));
+    rehash(table, table->oldsize);
+}
+
 void *Table_get(T table, const void *key) {
-    int i;
-    struct binding *p;
+    struct binding **pp;
     assert(table);
     assert(key);
-    i = (*table->hash)(key)%table->size;
-    for (p = table->buckets[i]; p; p = p->link)
-	if ((*table->cmp)(key, p->key) == 0)
-	    break;
-    return p ? p->value : NULL;
+    if (table->ctrl) {
+	int i = flatfind(table, key, Swiss_mix((*table->hash)(key)));
+	return i >= 0 ? table->slots[i].value : NULL;
+    }
+    pp = lookup(table, key, (*table->hash)(key));
+    return pp ? (*pp)->value : NULL;
 }
 
 void *Table_put(T table, const void *key, void *value) {
-    int i;
-    struct binding *p;
+    unsigned h;
+    struct binding *p, **pp;
     void *prev;
     assert(table);
     assert(key);
-    i = (*table->hash)(key)%table->size;
-    for (p = table->buckets[i]; p; p = p->link)
-	if ((*table->cmp)(key, p->key) == 0)
-	    break;
-    if (p == NULL) {
+    if (table->ctrl)
+	return flatput(table, key, value);
+    rehash(table, PUTSTEP);
+    h = (*table->hash)(key);
+    pp = lookup(table, key, h);
+    if (pp == NULL) {
+	int i = h%table->size;
 	NEW(p);
 	p->key = key;
+	p->hash = h;
 	p->link = table->buckets[i];
 	table->buckets[i] = p;
 	table->length++;
 	prev = NULL;
+	if (table->length > (long)table->load*table->size/100)
+	    resize(table, nextsize(2L*table->size));
     }
-    else
+    else {
+	p = *pp;
 	prev = p->value;
+    }
     p->value = value;
     table->timestamp++;
     return prev;
@@ -100,6 +302,19 @@ void Table_map(T table,
     assert(table);
     assert(apply);
     stamp = table->timestamp;
+    if (table->ctrl) {
+	for (i = 0; i < table->size; i++)
+	    if (table->ctrl[i] >= 0) {
+		apply(table->slots[i].key, &table->slots[i].value, cl);
+		assert(table->timestamp == stamp);
+	    }
+	return;
+    }
+    for (i = table->rehash; i < table->oldsize; i++)
+	for (p = table->old[i]; p; p = p->link) {
+	    apply(p->key, &p->value, cl);
+	    assert(table->timestamp == stamp);
+	}
     for (i = 0; i < table->size; i++)
 	for (p = table->buckets[i]; p; p = p->link) {
 	    apply(p->key, &p->value, cl);
@@ -108,21 +323,22 @@ void Table_map(T table,
 }
 
 void *Table_remove(T table, const void *key) {
-    int i;
     struct binding **pp;
     assert(table);
     assert(key);
     table->timestamp++;
-    i = (*table->hash)(key)%table->size;
-    for (pp = &table->buckets[i]; *pp; pp = &(*pp)->link)
-	if ((*table->cmp)(key, (*pp)->key) == 0) {
-	    struct binding *p = *pp;
-	    void *value = p->value;
-	    *pp = p->link;
-	    FREE(p);
-	    table->length--;
-	    return value;
-	}
+    if (table->ctrl)
+	return flatremove(table, key);
+    rehash(table, REMOVESTEP);
+    pp = lookup(table, key, (*table->hash)(key));
+    if (pp) {
+	struct binding *p = *pp;
+	void *value = p->value;
+	*pp = p->link;
+	FREE(p);
+	table->length--;
+	return value;
+    }
     return NULL;
 }
 
@@ -132,17 +348,38 @@ void **Table_toArray(T table, void *end) {
     struct binding *p;
     assert(table);
     array = ALLOC((2*table->length + 1)*sizeof (*array));
-    for (i = 0; i < table->size; i++)
-	for (p = table->buckets[i]; p; p = p->link) {
-	    array[j++] = (void *)p->key;
-	    array[j++] = p->value;
-	}
+    if (table->ctrl) {
+	for (i = 0; i < table->size; i++)
+	    if (table->ctrl[i] >= 0) {
+		array[j++] = (void *)table->slots[i].key;
+		array[j++] = table->slots[i].value;
+	    }
+    }
+    else {
+	for (i = table->rehash; i < table->oldsize; i++)
+	    for (p = table->old[i]; p; p = p->link) {
+		array[j++] = (void *)p->key;
+		array[j++] = p->value;
+	    }
+	for (i = 0; i < table->size; i++)
+	    for (p = table->buckets[i]; p; p = p->link) {
+		array[j++] = (void *)p->key;
+		array[j++] = p->value;
+	    }
+    }
     array[j] = end;
     return array;
 }
 
 void Table_free(T *table) {
     assert(table && *table);
+    if ((*table)->ctrl) {
+	FREE((*table)->ctrl);
+	FREE((*table)->slots);
+	FREE(*table);
+	return;
+    }
+    rehash(*table, (*table)->oldsize);
     if ((*table)->length > 0) {
 	int i;
 	struct binding *p, *q;
@@ -152,5 +389,6 @@ void Table_free(T *table) {
 		FREE(p);
 	    }
     }
+    FREE((*table)->buckets);
     FREE(*table);
 }
@@ -9,10 +9,18 @@ extern T Table_new (int hint,
     int cmp(const void *x, const void *y),
     unsigned hash(const void *key));
 
+extern T Table_new_flat(int hint,
+    int cmp(const void *x, const void *y),
+    unsigned hash(const void *key));
+
 extern void Table_free(T *table);
 
 extern int Table_length(T table);
 
+extern void Table_maxload(T table, int load);
+
+extern void Table_reserve(T table, int n);
+
 extern void *Table_put (T table, const void *key, void *value);
 
 extern void *Table_get (T table, const void *key);
@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "assert.h"
+#include "mem.h"
+#include "thread.h"
+#include "sem.h"
+
+#define T Thread_T
+
+struct T {
+    T link;
+    int (*apply)(void *);
+    void *args;
+    int code;
+    int done;
+    int njoin;
+    atomic_int alerted;
+    pthread_mutex_t waitlock;
+    Sem_T *wait;
+};
+
+const Except_T Thread_Failed = { "Thread creation failed" };
+
+const Except_T Thread_Alerted = { "Thread alerted" };
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_cond_t finished = PTHREAD_COND_INITIALIZER;
+
+static T threads;
+
+static int nthreads;
+
+static struct T root;
+
+static _Thread_local T current;
+
+static void init(T t) {
+    t->code = 0;
+    t->done = 0;
+    t->njoin = 0;
+    atomic_init(&t->alerted, 0);
+    pthread_mutex_init(&t->waitlock, NULL);
+    t->wait = NULL;
+}
+
+static void unlink(T t) {
+    T *pp;
+    for (pp = &threads; *pp; pp = &(*pp)->link)
+	if (*pp == t) {
+	    *pp = t->link;
+	    break;
+	}
+}
+
+static int known(T t) {
+    T p;
+    for (p = threads; p; p = p->link)
+	if (p == t)
+	    return 1;
+    return 0;
+}
+
+static void setwait(T t, Sem_T *s) {
+    pthread_mutex_lock(&t->waitlock);
+    t->wait = s;
+    pthread_mutex_unlock(&t->waitlock);
+}
+
+static void *start(void *cl) {
+    T t = cl;
+    current = t;
+    Thread_exit(t->apply(t->args));
+    return NULL;
+}
+
+int Thread_init(int preempt, ...) {
+    assert(preempt == 0 || preempt == 1);
+    assert(current == NULL);
+    init(&root);
+    pthread_mutex_lock(&lock);
+    root.link = threads;
+    threads = &root;
+    nthreads++;
+    pthread_mutex_unlock(&lock);
+    current = &root;
+    return 1;
+}
+
+T Thread_self(void) {
+    assert(current);
+    return current;
+}
+
+T Thread_new(int apply(void *), void *args, int nbytes, ...) {
+    T t;
+    pthread_t thread;
+    pthread_attr_t attr;
+    assert(current);
+    assert(apply);
+    assert(nbytes >= 0);
+    if (args == NULL)
+	nbytes = 0;
+    t = ALLOC(sizeof (*t) + nbytes);
+    init(t);
+    t->apply = apply;
+    if (nbytes > 0) {
+	t->args = t + 1;
+	memcpy(t->args, args, nbytes);
+    }
+    else
+	t->args = args;
+    pthread_mutex_lock(&lock);
+    t->link = threads;
+    threads = t;
+    nthreads++;
+    pthread_mutex_unlock(&lock);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, start, t) != 0) {
+	pthread_attr_destroy(&attr);
+	pthread_mutex_lock(&lock);
+	unlink(t);
+	nthreads--;
+	pthread_mutex_unlock(&lock);
+	FREE(t);
+	RAISE(Thread_Failed);
+    }
+    pthread_attr_destroy(&attr);
+    return t;
+}
+
+void Thread_exit(int code) {
+    T t = current;
+    assert(t);
+    pthread_mutex_lock(&lock);
+    t->code = code;
+    t->done = 1;
+    pthread_cond_broadcast(&finished);
+    if (--nthreads == 0) {
+	pthread_mutex_unlock(&lock);
+	exit(code);
+    }
+    pthread_mutex_unlock(&lock);
+    current = NULL;
+    pthread_exit(NULL);
+}
+
+int Thread_join(T t) {
+    T self = Thread_self(), dead = NULL, *pp;
+    int code = 0, alerted = 0, last = 0;
+    assert(t != self);
+    pthread_mutex_lock(&lock);
+    if (t) {
+	if (!known(t)) {
+	    pthread_mutex_unlock(&lock);
+	    return -1;
+	}
+	t->njoin++;
+	while (!t->done && !(alerted = atomic_load(&self->alerted)))
+	    pthread_cond_wait(&finished, &lock);
+	if (t->done)
+	    code = t->code;
+	last = --t->njoin == 0 && t->done && t != &root;
+	if (last)
+	    unlink(t);
+    }
+    else {
+	while (nthreads > 1 && !(alerted = atomic_load(&self->alerted)))
+	    pthread_cond_wait(&finished, &lock);
+	if (!alerted)
+	    for (pp = &threads; *pp; )
+		if ((*pp)->done && *pp != &root) {
+		    T p = *pp;
+		    *pp = p->link;
+		    p->link = dead;
+		    dead = p;
+		}
+		else
+		    pp = &(*pp)->link;
+    }
+    pthread_mutex_unlock(&lock);
+    if (last)
+	FREE(t);
+    while (dead) {
+	T p = dead;
+	dead = p->link;
+	FREE(p);
+    }
+    if (alerted) {
+	atomic_store(&self->alerted, 0);
+	RAISE(Thread_Alerted);
+    }
+    return code;
+}
+
+void Thread_alert(T t) {
+    assert(t);
+    atomic_store(&t->alerted, 1);
+    pthread_mutex_lock(&lock);
+    pthread_cond_broadcast(&finished);
+    pthread_mutex_unlock(&lock);
+    pthread_mutex_lock(&t->waitlock);
+    if (t->wait) {
+	pthread_mutex_lock(&t->wait->lock);
+	pthread_cond_broadcast(&t->wait->cond);
+	pthread_mutex_unlock(&t->wait->lock);
+    }
+    pthread_mutex_unlock(&t->waitlock);
+}
+
+void Thread_pause(void) {
+    assert(current);
+    sched_yield();
+}
+
+#undef T
+
+#define T Sem_T
+
+void Sem_init(T *s, int count) {
+    assert(s);
+    s->count = count;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+}
+
+T *Sem_new(int count) {
+    T *s;
+    NEW(s);
+    Sem_init(s, count);
+    return s;
+}
+
+void Sem_wait(T *s) {
+    Thread_T t = current;
+    int alerted = 0;
+    assert(s);
+    if (t)
+	setwait(t, s);
+    pthread_mutex_lock(&s->lock);
+    while (s->count <= 0 && !(alerted = t && atomic_load(&t->alerted)))
+	pthread_cond_wait(&s->cond, &s->lock);
+    if (!alerted)
+	s->count--;
+    pthread_mutex_unlock(&s->lock);
+    if (t)
+	setwait(t, NULL);
+    if (alerted) {
+	atomic_store(&t->alerted, 0);
+	RAISE(Thread_Alerted);
+    }
+}
+
+void Sem_signal(T *s) {
+    assert(s);
+    pthread_mutex_lock(&s->lock);
+    s->count++;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+}
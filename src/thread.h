@@ -0,0 +1,40 @@
+#ifndef THREAD_INCLUDED
+#define THREAD_INCLUDED
+
+#include "except.h"
+
+#define T Thread_T
+
+typedef struct T *T;
+
+extern const Except_T Thread_Failed;
+
+extern const Except_T Thread_Alerted;
+
+extern int Thread_init (int preempt, ...);
+
+extern T Thread_new (int apply(void *),
+    void *args, int nbytes, ...);
+
+extern void Thread_exit (int code);
+
+extern void Thread_alert(T t);
+
+extern T Thread_self (void);
+
+/*
+ * A thread's handle outlives the thread so that Thread_join can
+ * return its exit code. The handle is freed when a Thread_join on it
+ * returns, or when Thread_join(NULL) returns, which frees the handles
+ * of all exited threads. Every Thread_new must be matched by one of
+ * these joins; a thread that is never joined keeps its handle until
+ * the process exits. A freed handle must not be passed to any Thread
+ * function.
+ */
+extern int Thread_join (T t);
+
+extern void Thread_pause(void);
+
+#undef T
+
+#endif
@@ -132,6 +132,23 @@ int XP_div(int n, T q, T x, int m, T y, T r, T tmp) {
 	    return 0;
 	r[0] = XP_quotient(nx, q, x, y[0]);
 	memset(r + 1, '\0', my - 1);
+    } else if (m < (int)sizeof (unsigned long) && m <= n) {
+	int i, k;
+	unsigned long d = 0, rem = 0;
+	for (i = m - 1; i >= 0; i--)
+	    d = d*BASE + y[i];
+	if ((d&(d - 1)) == 0) {
+	    for (k = 0; (1UL<<k) < d; k++)
+		;
+	    rem = XP_toint(m, x)&(d - 1);
+	    XP_rshift(nx, q, n, x, k, 0);
+	} else
+	    for (i = nx - 1; i >= 0; i--) {
+		rem = rem*BASE + x[i];
+		q[i] = rem/d;
+		rem %= d;
+	    }
+	XP_fromint(my, r, rem);
     } else if (m > n) {
 	memset(q, '\0', nx);
 	memcpy(r, x, n);
@@ -0,0 +1,843 @@
+#include <ctype.h>
+#include <string.h>
+#include "assert.h"
+#include "mem.h"
+#include "xpw.h"
+
+#define T XPW_T
+
+#define BITS XPW_BITS
+
+#ifndef KARATSUBA
+#define KARATSUBA 32
+#endif
+
+#define NEWTON 1000
+
+typedef XPW_limb limb;
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 dlimb;
+#else
+typedef uint64_t dlimb;
+#endif
+
+static char map[] = {
+    0,  1,  2,  3,  4,  5,  6,  7,  8,  9,
+    36, 36, 36, 36, 36, 36, 36,
+    10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22,
+    23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35,
+    36, 36, 36, 36, 36, 36,
+    10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22,
+    23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35
+};
+
+static int nlz(limb x) {
+    int n = 0;
+    if (x == 0)
+	return BITS;
+#ifdef __GNUC__
+    if (BITS == 64)
+	return __builtin_clzll(x);
+#endif
+    while ((x>>(BITS - 1)) == 0) {
+	x <<= 1;
+	n++;
+    }
+    return n;
+}
+
+static limb chunk(int base, int *k) {
+    limb b = base;
+    for (*k = 1; b <= ~(limb)0/base; (*k)++)
+	b *= base;
+    return b;
+}
+
+unsigned long XPW_fromint(int n, T z, unsigned long u) {
+    int i = 0;
+    do {
+	z[i++] = (limb)u;
+	u = sizeof (limb) >= sizeof u ? 0 : u>>(BITS - 1)>>1;
+    } while (u > 0 && i < n);
+    for ( ; i < n; i++)
+	z[i] = 0;
+    return u;
+}
+
+unsigned long XPW_toint(int n, T x) {
+    unsigned long u = 0;
+    int i = (int)((sizeof u + sizeof (limb) - 1)/sizeof (limb));
+    if (i > n)
+	i = n;
+    while (--i >= 0)
+	u = (u<<(BITS - 1)<<1) | x[i];
+    return u;
+}
+
+int XPW_length(int n, T x) {
+    while (n > 1 && x[n-1] == 0)
+	n--;
+    return n;
+}
+
+void XPW_frombytes(int n, T z, int m, XP_T x) {
+    int i, j;
+    for (i = 0; i < n; i++) {
+	limb d = 0;
+	for (j = sizeof (limb) - 1; j >= 0; j--)
+	    if (i*(int)sizeof (limb) + j < m)
+		d = (d<<8) | x[i*sizeof (limb) + j];
+	    else
+		d <<= 8;
+	z[i] = d;
+    }
+}
+
+void XPW_tobytes(int m, XP_T z, int n, T x) {
+    int i;
+    for (i = 0; i < m; i++)
+	z[i] = i/(int)sizeof (limb) < n
+	    ? (unsigned char)(x[i/sizeof (limb)]>>(8*(i%sizeof (limb)))) : 0;
+}
+
+int XPW_add(int n, T z, T x, T y, int carry) {
+    int i;
+    for (i = 0; i < n; i++) {
+	dlimb t = (dlimb)x[i] + y[i] + carry;
+	z[i] = (limb)t;
+	carry = (int)(t>>BITS);
+    }
+    return carry;
+}
+
+int XPW_sub(int n, T z, T x, T y, int borrow) {
+    int i;
+    for (i = 0; i < n; i++) {
+	dlimb d = (dlimb)x[i] - y[i] - borrow;
+	z[i] = (limb)d;
+	borrow = (int)(d>>BITS)&1;
+    }
+    return borrow;
+}
+
+limb XPW_sum(int n, T z, T x, limb y) {
+    int i;
+    for (i = 0; i < n; i++) {
+	limb s = x[i] + y;
+	y = s < y;
+	z[i] = s;
+    }
+    return y;
+}
+
+limb XPW_diff(int n, T z, T x, limb y) {
+    int i;
+    for (i = 0; i < n; i++) {
+	limb d = x[i] - y;
+	y = x[i] < y;
+	z[i] = d;
+    }
+    return y;
+}
+
+int XPW_neg(int n, T z, T x, int carry) {
+    int i;
+    for (i = 0; i < n; i++) {
+	limb s = ~x[i] + carry;
+	carry = carry && s == 0;
+	z[i] = s;
+    }
+    return carry;
+}
+
+static void mulbasic(T z, int n, T x, int m, T y) {
+    int i, j;
+    memset(z, '\0', (n + m)*sizeof (limb));
+    for (i = 0; i < n; i++) {
+	limb carry = 0;
+	for (j = 0; j < m; j++) {
+	    dlimb t = (dlimb)x[i]*y[j] + z[i+j] + carry;
+	    z[i+j] = (limb)t;
+	    carry = (limb)(t>>BITS);
+	}
+	z[i+m] = carry;
+    }
+}
+
+static void sqrbasic(T z, int n, T x) {
+    int i, j;
+    limb carry;
+    memset(z, '\0', 2*n*sizeof (limb));
+    for (i = 0; i < n; i++) {
+	carry = 0;
+	for (j = i + 1; j < n; j++) {
+	    dlimb t = (dlimb)x[i]*x[j] + z[i+j] + carry;
+	    z[i+j] = (limb)t;
+	    carry = (limb)(t>>BITS);
+	}
+	z[i+n] = carry;
+    }
+    XPW_lshift(2*n, z, 2*n, z, 1, 0);
+    carry = 0;
+    for (i = 0; i < n; i++) {
+	dlimb p = (dlimb)x[i]*x[i], t;
+	t = (dlimb)z[2*i] + (limb)p + carry;
+	z[2*i] = (limb)t;
+	t = (dlimb)z[2*i+1] + (limb)(p>>BITS) + (limb)(t>>BITS);
+	z[2*i+1] = (limb)t;
+	carry = (limb)(t>>BITS);
+    }
+}
+
+static int space(int n, int m) {
+    int h, s;
+    if (n < m)
+	return space(m, n);
+    if (m < KARATSUBA)
+	return 0;
+    if (n == m) {
+	h = n - n/2;
+	return 4*(h + 1) + space(h + 1, h + 1);
+    }
+    s = 2*m + space(m, m);
+    if (n%m > 0 && n%m + m + space(m, n%m) > s)
+	s = n%m + m + space(m, n%m);
+    return s;
+}
+
+static void kmul(T z, T x, T y, int n, T tmp) {
+    int l = n/2, h = n - l, c;
+    T sx = tmp, sy = tmp + h + 1, p = sy + h + 1;
+    if (n < KARATSUBA) {
+	if (x == y)
+	    sqrbasic(z, n, x);
+	else
+	    mulbasic(z, n, x, n, y);
+	return;
+    }
+    kmul(z, x, y, l, p + 2*(h + 1));
+    kmul(z + 2*l, x + l, y + l, h, p + 2*(h + 1));
+    c = XPW_add(l, sx, x + l, x, 0);
+    sx[h] = XPW_sum(h - l, sx + l, x + 2*l, c);
+    if (x == y)
+	sy = sx;
+    else {
+	c = XPW_add(l, sy, y + l, y, 0);
+	sy[h] = XPW_sum(h - l, sy + l, y + 2*l, c);
+    }
+    kmul(p, sx, sy, h + 1, p + 2*(h + 1));
+    c = XPW_sub(2*l, p, p, z, 0);
+    XPW_diff(2*(h - l) + 2, p + 2*l, p + 2*l, c);
+    c = XPW_sub(2*h, p, p, z + 2*l, 0);
+    XPW_diff(2, p + 2*h, p + 2*h, c);
+    c = XPW_add(2*h + 2, z + l, z + l, p, 0);
+    XPW_sum(l - 2, z + l + 2*h + 2, z + l + 2*h + 2, c);
+}
+
+static void mul(T z, int n, T x, int m, T y, T tmp) {
+    int i;
+    if (n < m) {
+	mul(z, m, y, n, x, tmp);
+	return;
+    }
+    if (m < KARATSUBA) {
+	mulbasic(z, n, x, m, y);
+	return;
+    }
+    if (n == m) {
+	kmul(z, x, y, n, tmp);
+	return;
+    }
+    memset(z, '\0', (n + m)*sizeof (limb));
+    for (i = 0; i < n; i += m) {
+	int k = n - i < m ? n - i : m;
+	limb c;
+	mul(tmp, k, x + i, m, y, tmp + k + m);
+	c = XPW_add(k + m, z + i, z + i, tmp, 0);
+	XPW_sum(n - i - k, z + i + k + m, z + i + k + m, c);
+    }
+}
+
+int XPW_mul(T z, int n, T x, int m, T y) {
+    int i, j;
+    limb carryout = 0;
+    if (n >= KARATSUBA && m >= KARATSUBA) {
+	T p = ALLOC((n + m + space(n, m))*sizeof (limb));
+	mul(p, n, x, m, y, p + n + m);
+	carryout = XPW_add(n + m, z, z, p, 0);
+	FREE(p);
+	return carryout != 0;
+    }
+    for (i = 0; i < n; i++) {
+	limb carry = 0;
+	for (j = 0; j < m; j++) {
+	    dlimb t = (dlimb)x[i]*y[j] + z[i+j] + carry;
+	    z[i+j] = (limb)t;
+	    carry = (limb)(t>>BITS);
+	}
+	for ( ; carry && j < n + m - i; j++) {
+	    z[i+j] += carry;
+	    carry = z[i+j] < carry;
+	}
+	carryout |= carry;
+    }
+    return carryout != 0;
+}
+
+int XPW_square(T z, int n, T x) {
+    int carry;
+    if (n < KARATSUBA) {
+	limb p[2*KARATSUBA];
+	sqrbasic(p, n, x);
+	return XPW_add(2*n, z, z, p, 0);
+    } else {
+	T p = ALLOC((2*n + space(n, n))*sizeof (limb));
+	kmul(p, x, x, n, p + 2*n);
+	carry = XPW_add(2*n, z, z, p, 0);
+	FREE(p);
+	return carry;
+    }
+}
+
+limb XPW_product(int n, T z, T x, limb y) {
+    int i;
+    limb carry = 0;
+    for (i = 0; i < n; i++) {
+	dlimb t = (dlimb)x[i]*y + carry;
+	z[i] = (limb)t;
+	carry = (limb)(t>>BITS);
+    }
+    return carry;
+}
+
+struct plan {
+    limb y, d, v;
+    int s;
+};
+
+static _Thread_local struct plan last;
+
+static limb div2by1(limb *q, limb u1, limb u0, limb d, limb v) {
+    dlimb p = (dlimb)v*u1 + (((dlimb)u1<<BITS) | u0);
+    limb q1 = (limb)(p>>BITS) + 1, r = u0 - q1*d;
+    if (r > (limb)p) {
+	q1--;
+	r += d;
+    }
+    if (r >= d) {
+	q1++;
+	r -= d;
+    }
+    *q = q1;
+    return r;
+}
+
+limb XPW_quotient(int n, T z, T x, limb y) {
+    int i, s;
+    limb r, d, v;
+    if (n == 1) {
+	r = x[0]%y;
+	z[0] = x[0]/y;
+	return r;
+    }
+    if ((y&(y - 1)) == 0) {
+	r = x[0]&(y - 1);
+	XPW_rshift(n, z, n, x, BITS - 1 - nlz(y), 0);
+	return r;
+    }
+    if (last.y != y) {
+	last.s = nlz(y);
+	last.d = y<<last.s;
+	last.v = (limb)((((dlimb)~last.d<<BITS) | ~(limb)0)/last.d);
+	last.y = y;
+    }
+    s = last.s;
+    d = last.d;
+    v = last.v;
+    if (s == 0) {
+	for (r = 0, i = n - 1; i >= 0; i--)
+	    r = div2by1(&z[i], r, x[i], d, v);
+	return r;
+    }
+    r = x[n-1]>>(BITS - s);
+    for (i = n - 1; i > 0; i--)
+	r = div2by1(&z[i], r, (x[i]<<s) | (x[i-1]>>(BITS - s)), d, v);
+    r = div2by1(&z[0], r, x[0]<<s, d, v);
+    return r>>s;
+}
+
+int XPW_div(int n, T q, T x, int m, T y, T r, T tmp) {
+    int nx = n, my = m;
+    n = XPW_length(n, x);
+    m = XPW_length(m, y);
+    if (m == 1) {
+	limb d = y[0];
+	if (d == 0)
+	    return 0;
+	r[0] = XPW_quotient(nx, q, x, d);
+	memset(r + 1, '\0', (my - 1)*sizeof (limb));
+    } else if (m > n) {
+	memcpy(r, x, n*sizeof (limb));
+	memset(r + n, '\0', (my - n)*sizeof (limb));
+	memset(q, '\0', nx*sizeof (limb));
+    } else {
+	int i, j, s = nlz(y[m-1]);
+	limb *u = tmp, *v = tmp + n + 1;
+	XPW_lshift(m, v, m, y, s, 0);
+	XPW_lshift(n + 1, u, n, x, s, 0);
+	for (j = n - m; j >= 0; j--) {
+	    dlimb num = ((dlimb)u[j+m]<<BITS) | u[j+m-1];
+	    dlimb qhat = num/v[m-1], rhat = num%v[m-1];
+	    limb carry = 0;
+	    int borrow = 0;
+	    while (qhat>>BITS || qhat*v[m-2] > ((rhat<<BITS) | u[j+m-2])) {
+		qhat--;
+		rhat += v[m-1];
+		if (rhat>>BITS)
+		    break;
+	    }
+	    for (i = 0; i < m; i++) {
+		dlimb p = qhat*v[i] + carry, t;
+		carry = (limb)(p>>BITS);
+		t = (dlimb)u[i+j] - (limb)p - borrow;
+		u[i+j] = (limb)t;
+		borrow = (int)(t>>BITS)&1;
+	    }
+	    {
+		dlimb t = (dlimb)u[j+m] - carry - borrow;
+		u[j+m] = (limb)t;
+		if ((t>>BITS)&1) {
+		    qhat--;
+		    u[j+m] += XPW_add(m, &u[j], &u[j], v, 0);
+		}
+	    }
+	    q[j] = (limb)qhat;
+	}
+	XPW_rshift(m, r, m + 1, u, s, 0);
+	for (i = n - m + 1; i < nx; i++)
+	    q[i] = 0;
+	for (i = m; i < my; i++)
+	    r[i] = 0;
+    }
+    return 1;
+}
+
+limb XPW_montinv(limb m) {
+    limb inv = m;
+    int i;
+    assert(m&1);
+    for (i = 3; i < BITS; i *= 2)
+	inv *= 2 - m*inv;
+    return -inv;
+}
+
+void XPW_montmul(int n, T z, T x, T y, T m, limb k, T tmp) {
+    int i, j;
+    memset(tmp, '\0', (n + 2)*sizeof (limb));
+    for (i = 0; i < n; i++) {
+	limb carry = 0, u;
+	dlimb t;
+	for (j = 0; j < n; j++) {
+	    t = (dlimb)x[i]*y[j] + tmp[j] + carry;
+	    tmp[j] = (limb)t;
+	    carry = (limb)(t>>BITS);
+	}
+	t = (dlimb)tmp[n] + carry;
+	tmp[n] = (limb)t;
+	tmp[n+1] = (limb)(t>>BITS);
+	u = tmp[0]*k;
+	t = (dlimb)u*m[0] + tmp[0];
+	carry = (limb)(t>>BITS);
+	for (j = 1; j < n; j++) {
+	    t = (dlimb)u*m[j] + tmp[j] + carry;
+	    tmp[j-1] = (limb)t;
+	    carry = (limb)(t>>BITS);
+	}
+	t = (dlimb)tmp[n] + carry;
+	tmp[n-1] = (limb)t;
+	tmp[n] = tmp[n+1] + (limb)(t>>BITS);
+    }
+    if (tmp[n] || XPW_cmp(n, tmp, m) >= 0)
+	XPW_sub(n, z, tmp, m, 0);
+    else
+	memcpy(z, tmp, n*sizeof (limb));
+}
+
+int XPW_cmp(int n, T x, T y) {
+    int i = n - 1;
+    while (i > 0 && x[i] == y[i])
+	i--;
+    return x[i] < y[i] ? -1 : x[i] > y[i];
+}
+
+void XPW_lshift(int n, T z, int m, T x, int s, int fill) {
+    limb f = fill ? ~(limb)0 : 0;
+    int i, w = s/BITS, b = s%BITS;
+    for (i = n - 1; i >= 0; i--) {
+	int k = i - w;
+	limb hi = k < 0 ? f : k < m ? x[k] : 0;
+	if (b > 0) {
+	    limb lo = k - 1 < 0 ? f : k - 1 < m ? x[k-1] : 0;
+	    hi = (hi<<b) | (lo>>(BITS - b));
+	}
+	z[i] = hi;
+    }
+}
+
+void XPW_rshift(int n, T z, int m, T x, int s, int fill) {
+    limb f = fill ? ~(limb)0 : 0;
+    int i, w = s/BITS, b = s%BITS;
+    for (i = 0; i < n; i++) {
+	int k = i + w;
+	limb lo = k < m ? x[k] : f;
+	if (b > 0) {
+	    limb hi = k + 1 < m ? x[k+1] : f;
+	    lo = (lo>>b) | (hi<<(BITS - b));
+	}
+	z[i] = lo;
+    }
+}
+
+struct power {
+    int m, s, digits;
+    T p, n, r;
+};
+
+static int log2base(int base) {
+    int d = 0;
+    while ((1<<d) < base)
+	d++;
+    return (1<<d) == base ? d : 0;
+}
+
+static void product(T z, int n, T x, int m, T y) {
+    T tmp = ALLOC((space(n, m) + 1)*sizeof (limb));
+    mul(z, n, x, m, y, tmp);
+    FREE(tmp);
+}
+
+static int above(int m, T t) {
+    return t[2*m] > 1
+	|| (t[2*m] == 1 && (XPW_length(2*m, t) > 1 || t[0] != 0));
+}
+
+static void reciprocal(T r, int m, T p) {
+    if (m < KARATSUBA) {
+	T u = ALLOC((8*m + 5)*sizeof (limb)), q = u + 2*m + 1;
+	memset(u, '\0', 2*m*sizeof (limb));
+	u[2*m] = 1;
+	XPW_div(2*m + 1, q, u, m, p, q + 2*m + 1, q + 3*m + 1);
+	memcpy(r, q, (m + 1)*sizeof (limb));
+	FREE(u);
+    } else {
+	int h = m - m/2, le, lc, neg;
+	T t = ALLOC((7*m + 4)*sizeof (limb)), u = t + 2*m + 1,
+	    d = u + 2*m + 1;
+	memset(r, '\0', (m - h)*sizeof (limb));
+	reciprocal(r + m - h, h, p + m - h);
+	product(t, m, p, m + 1, r);
+	neg = t[2*m] != 0;
+	if (neg)
+	    t[2*m]--;
+	else
+	    XPW_neg(2*m, t, t, 1);
+	le = XPW_length(2*m + 1, t);
+	product(d, m + 1, r, le, t);
+	lc = m + 1 + le - 2*m;
+	if (lc > m + 1)
+	    lc = m + 1;
+	if (lc > 0 && neg)
+	    XPW_diff(m + 1 - lc, r + lc, r + lc,
+		XPW_sub(lc, r, r, d + 2*m, 1));
+	else if (lc > 0)
+	    XPW_sum(m + 1 - lc, r + lc, r + lc,
+		XPW_add(lc, r, r, d + 2*m, 0));
+	product(t, m, p, m + 1, r);
+	while (above(m, t)) {
+	    XPW_diff(m + 1, r, r, 1);
+	    XPW_diff(m + 1, t + m, t + m, XPW_sub(m, t, t, p, 0));
+	}
+	for (;;) {
+	    XPW_sum(m + 1, u + m, t + m, XPW_add(m, u, t, p, 0));
+	    if (above(m, u))
+		break;
+	    memcpy(t, u, (2*m + 1)*sizeof (limb));
+	    XPW_sum(m + 1, r, r, 1);
+	}
+	FREE(t);
+    }
+}
+
+static struct power *power(struct power *pw, int i) {
+    if (pw[i].p == NULL) {
+	struct power *pr = power(pw, i - 1);
+	pw[i].p = ALLOC(2*pr->m*sizeof (limb));
+	product(pw[i].p, pr->m, pr->p, pr->m, pr->p);
+	pw[i].m = XPW_length(2*pr->m, pw[i].p);
+	pw[i].digits = 2*pr->digits;
+    }
+    return &pw[i];
+}
+
+static void divide(struct power *pw, T q, T r, int n, T x) {
+    int m = pw->m;
+    T xs, d, t;
+    if (m < NEWTON) {
+	xs = ALLOC((4*n + 2)*sizeof (limb));
+	XPW_div(n, xs, x, m, pw->p, r, xs + n);
+	memcpy(q, xs, m*sizeof (limb));
+	FREE(xs);
+	return;
+    }
+    xs = ALLOC((7*m + 1)*sizeof (limb));
+    d = xs + 2*m;
+    t = d + 3*m + 1;
+    if (pw->n == NULL) {
+	pw->s = nlz(pw->p[m-1]);
+	pw->n = ALLOC((2*m + 1)*sizeof (limb));
+	pw->r = pw->n + m;
+	XPW_lshift(m, pw->n, m, pw->p, pw->s, 0);
+	reciprocal(pw->r, m, pw->n);
+    }
+    XPW_lshift(2*m, xs, n, x, pw->s, 0);
+    product(d, 2*m, xs, m + 1, pw->r);
+    memcpy(q, d + 2*m, m*sizeof (limb));
+    product(t, m, q, m, pw->n);
+    XPW_sub(2*m, xs, xs, t, 0);
+    while (XPW_length(2*m, xs) > m || XPW_cmp(m, xs, pw->n) >= 0) {
+	XPW_diff(m, xs + m, xs + m, XPW_sub(m, xs, xs, pw->n, 0));
+	XPW_sum(m, q, q, 1);
+    }
+    XPW_rshift(m, r, m, xs, pw->s, 0);
+    FREE(xs);
+}
+
+static int tochunks(char *str, int size, int base, int n, T x,
+	int width) {
+    int i = 0, k;
+    limb big = chunk(base, &k);
+    do {
+	limb r = XPW_quotient(n, x, x, big);
+	int j;
+	while (n > 1 && x[n-1] == 0)
+	    n--;
+	for (j = 0; j < k && (r != 0 || n > 1 || x[0] != 0 || j == 0); j++) {
+	    assert(i < size);
+	    str[i++] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"[r%base];
+	    r /= base;
+	}
+    } while (n > 1 || x[0] != 0);
+    for ( ; i < width; i++) {
+	assert(i < size);
+	str[i] = '0';
+    }
+    {
+	int j, h;
+	for (j = 0, h = i - 1; j < h; j++, h--) {
+	    char c = str[j];
+	    str[j] = str[h];
+	    str[h] = c;
+	}
+    }
+    return i;
+}
+
+static int tostr(char *str, int size, int base, int n, T x,
+	struct power *pw, int i, int width) {
+    struct power *p;
+    T q, r;
+    int len;
+    n = XPW_length(n, x);
+    if (i < 0 || n < KARATSUBA)
+	return tochunks(str, size, base, n, x, width);
+    p = power(pw, i);
+    if (width == 0 && (n < p->m
+    || (n == p->m && XPW_cmp(n, x, p->p) < 0)))
+	return tostr(str, size, base, n, x, pw, i - 1, 0);
+    q = ALLOC(2*p->m*sizeof (limb));
+    r = q + p->m;
+    divide(p, q, r, n, x);
+    len = tostr(str, size, base, p->m, q, pw, i - 1,
+	width ? width - p->digits : 0);
+    len += tostr(str + len, size - len, base, p->m, r, pw, i - 1,
+	p->digits);
+    FREE(q);
+    return len;
+}
+
+static int tobits(char *str, int size, int base, int n, T x) {
+    int d = log2base(base), i = 0, j;
+    long nbits = (long)(n - 1)*BITS + BITS - nlz(x[n-1]);
+    for (j = nbits > 0 ? (int)((nbits - 1)/d) : 0; j >= 0; j--) {
+	long pos = (long)j*d;
+	int w = (int)(pos/BITS), b = (int)(pos%BITS);
+	limb v = x[w]>>b;
+	if (b + d > BITS && w + 1 < n)
+	    v |= x[w+1]<<(BITS - b);
+	assert(i < size);
+	str[i++] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"[v&(base - 1)];
+    }
+    return i;
+}
+
+static int bound(int len, int base) {
+    int bits = 1;
+    while ((1<<bits) < base)
+	bits++;
+    return (int)((long)len*bits/BITS) + 2;
+}
+
+static int fromchunks(T z, const char *str, int len, int base) {
+    int k, n = bound(len, base);
+    memset(z, '\0', n*sizeof (limb));
+    chunk(base, &k);
+    while (len > 0) {
+	limb d = 0, b = 1;
+	int j;
+	for (j = 0; j < k && len > 0; j++, len--, str++) {
+	    d = d*base + map[*str-'0'];
+	    b *= base;
+	}
+	XPW_product(n, z, z, b);
+	XPW_sum(n, z, z, d);
+    }
+    return XPW_length(n, z);
+}
+
+static int fromstr(T z, const char *str, int len, int base,
+	struct power *pw, int i) {
+    struct power *p;
+    int n, nh, nl;
+    T h, l;
+    while (i >= 0 && (pw[0].digits<<i) >= len)
+	i--;
+    if (i < 0 || len <= pw[0].digits*KARATSUBA)
+	return fromchunks(z, str, len, base);
+    p = power(pw, i);
+    nh = bound(len - p->digits, base);
+    h = ALLOC((nh + bound(p->digits, base))*sizeof (limb));
+    l = h + nh;
+    nh = fromstr(h, str, len - p->digits, base, pw, i - 1);
+    nl = fromstr(l, str + len - p->digits, p->digits, base, pw, i - 1);
+    product(z, nh, h, p->m, p->p);
+    n = nh + p->m;
+    XPW_sum(n - nl, z + nl, z + nl, XPW_add(nl, z, z, l, 0));
+    FREE(h);
+    return XPW_length(n, z);
+}
+
+static int frombits(T z, const char *str, int len, int base) {
+    int d = log2base(base), n = bound(len, base), j;
+    memset(z, '\0', n*sizeof (limb));
+    for (j = 0; j < len; j++) {
+	long pos = (long)(len - 1 - j)*d;
+	int w = (int)(pos/BITS), b = (int)(pos%BITS);
+	limb v = map[str[j]-'0'];
+	z[w] |= v<<b;
+	if (b + d > BITS)
+	    z[w+1] |= v>>(BITS - b);
+    }
+    return XPW_length(n, z);
+}
+
+static void release(struct power *pw) {
+    int i;
+    for (i = 0; i < 32 && pw[i].p; i++) {
+	if (pw[i].n)
+	    FREE(pw[i].n);
+	if (i > 0)
+	    FREE(pw[i].p);
+    }
+}
+
+int XPW_fromstr(int n, T z, const char *str,
+	int base, char **end) {
+    const char *p = str;
+    assert(p);
+    assert(base >= 2 && base <= 36);
+    while (*p && isspace(*p))
+	p++;
+    if ((*p && isalnum(*p) && map[*p-'0'] < base)) {
+	int k, carry = 0, len = 0;
+	limb big = chunk(base, &k);
+	while (p[len] && isalnum(p[len]) && map[p[len]-'0'] < base)
+	    len++;
+	if (XPW_length(n, z) == 1 && z[0] == 0
+	&& (log2base(base) || len > k*KARATSUBA)) {
+	    T t = ALLOC(bound(len, base)*sizeof (limb));
+	    int m;
+	    if (log2base(base))
+		m = frombits(t, p, len, base);
+	    else {
+		struct power pw[32];
+		int i;
+		memset(pw, '\0', sizeof pw);
+		pw[0].m = 1;
+		pw[0].digits = k;
+		pw[0].p = &big;
+		for (i = 0; (long)k<<(i + 1) < len; i++)
+		    ;
+		m = fromstr(t, p, len, base, pw, i);
+		release(pw);
+	    }
+	    if (m <= n) {
+		memcpy(z, t, m*sizeof (limb));
+		memset(z + m, '\0', (n - m)*sizeof (limb));
+		FREE(t);
+		if (end)
+		    *end = (char *)p + len;
+		return 0;
+	    }
+	    FREE(t);
+	}
+	while (*p && isalnum(*p) && map[*p-'0'] < base) {
+	    limb d = 0, b = 1;
+	    int i;
+	    for (i = 0; i < k && *p && isalnum(*p) && map[*p-'0'] < base;
+		i++, p++) {
+		d = d*base + map[*p-'0'];
+		b *= base;
+	    }
+	    if (XPW_product(n, z, z, b) || XPW_sum(n, z, z, d)) {
+		carry = 1;
+		break;
+	    }
+	}
+	if (end)
+	    *end = (char *)p;
+	return carry;
+    } else {
+	if (end)
+	    *end = (char *)str;
+	return 0;
+    }
+}
+
+char *XPW_tostr(char *str, int size, int base,
+	int n, T x) {
+    int len;
+    assert(str);
+    assert(base >= 2 && base <= 36);
+    n = XPW_length(n, x);
+    if (log2base(base))
+	len = tobits(str, size, base, n, x);
+    else if (n < KARATSUBA)
+	len = tochunks(str, size, base, n, x, 0);
+    else {
+	struct power pw[32];
+	int i, k;
+	limb big = chunk(base, &k);
+	memset(pw, '\0', sizeof pw);
+	pw[0].m = 1;
+	pw[0].digits = k;
+	pw[0].p = &big;
+	for (i = 0; 2*power(pw, i)->m - 2 < n; i++)
+	    ;
+	len = tostr(str, size, base, n, x, pw, i, 0);
+	release(pw);
+    }
+    assert(len < size);
+    str[len] = '\0';
+    return str;
+}
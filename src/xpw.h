@@ -0,0 +1,68 @@
+#ifndef XPW_INCLUDED
+#define XPW_INCLUDED
+
+#include <stdint.h>
+#include "xp.h"
+
+#ifdef __SIZEOF_INT128__
+typedef uint64_t XPW_limb;
+#else
+typedef uint32_t XPW_limb;
+#endif
+
+#define XPW_BITS (8*(int)sizeof (XPW_limb))
+
+#define T XPW_T
+
+typedef XPW_limb *T;
+
+extern int XPW_add(int n, T z, T x, T y, int carry);
+
+extern int XPW_sub(int n, T z, T x, T y, int borrow);
+
+extern int XPW_mul(T z, int n, T x, int m, T y);
+
+extern int XPW_square(T z, int n, T x);
+
+extern int XPW_div(int n, T q, T x, int m, T y, T r, T tmp);
+
+extern XPW_limb XPW_sum(int n, T z, T x, XPW_limb y);
+
+extern XPW_limb XPW_diff(int n, T z, T x, XPW_limb y);
+
+extern XPW_limb XPW_product(int n, T z, T x, XPW_limb y);
+
+extern XPW_limb XPW_quotient(int n, T z, T x, XPW_limb y);
+
+extern int XPW_neg(int n, T z, T x, int carry);
+
+extern XPW_limb XPW_montinv(XPW_limb m);
+
+extern void XPW_montmul(int n, T z, T x, T y, T m, XPW_limb k,
+	T tmp);
+
+extern int XPW_cmp(int n, T x, T y);
+
+extern void XPW_lshift(int n, T z, int m, T x,
+	int s, int fill);
+
+extern void XPW_rshift(int n, T z, int m, T x,
+	int s, int fill);
+
+extern int XPW_length(int n, T x);
+
+extern unsigned long XPW_fromint(int n, T z, unsigned long u);
+
+extern unsigned long XPW_toint(int n, T x);
+
+extern void XPW_frombytes(int n, T z, int m, XP_T x);
+
+extern void XPW_tobytes(int m, XP_T z, int n, T x);
+
+extern int XPW_fromstr(int n, T z, const char *str, int base, char **end);
+
+extern char *XPW_tostr(char *str, int size, int base, int n, T x);
+
+#undef T
+
+#endif